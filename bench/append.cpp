@@ -0,0 +1,69 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+
+// Benchmarks appending a batch of m random elements to a sorted array of n elements and sorting it
+// again, for m = 1, 10, ... up to n: pdqsort_append against pdqsort on the whole array and against
+// sorting the batch and merging it with std::inplace_merge.
+//
+// Usage: append [n]
+//
+// Output is one line per (m, algorithm): the median ns per call over one second of runs.
+
+double median_ns(const std::vector<int>& input, std::size_t n,
+                 std::function<void(std::vector<int>&, std::size_t)> run) {
+    std::vector<double> ns;
+    std::vector<int> v;
+
+    auto total_start = std::chrono::steady_clock::now();
+    while (ns.size() < 3 ||
+           std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+        v = input;
+        auto start = std::chrono::steady_clock::now();
+        run(v, n);
+        auto end = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+
+    std::sort(ns.begin(), ns.end());
+    return ns[ns.size() / 2];
+}
+
+
+int main(int argc, char** argv) {
+    std::size_t n = argc > 1 ? std::size_t(std::atol(argv[1])) : 1000000;
+
+    std::mt19937_64 rng(42);
+    std::vector<int> sorted(n);
+    for (auto& x : sorted) x = int(rng());
+    std::sort(sorted.begin(), sorted.end());
+
+    for (std::size_t m = 1; m <= n; m *= 10) {
+        std::vector<int> input(sorted);
+        for (std::size_t i = 0; i < m; ++i) input.push_back(int(rng()));
+
+        std::cout << m << " pdqsort_append "
+                  << median_ns(input, n, [](std::vector<int>& v, std::size_t n) {
+            pdqsort_append(v.begin(), v.begin() + n, v.end());
+        }) << "\n";
+        std::cout << m << " pdqsort "
+                  << median_ns(input, n, [](std::vector<int>& v, std::size_t) {
+            pdqsort(v.begin(), v.end());
+        }) << "\n";
+        std::cout << m << " std::sort+std::inplace_merge "
+                  << median_ns(input, n, [](std::vector<int>& v, std::size_t n) {
+            std::sort(v.begin() + n, v.end());
+            std::inplace_merge(v.begin(), v.begin() + n, v.end());
+        }) << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+
+// Benchmarks pdqsort_auto against every single engine it can choose that applies to an input, for
+// inputs that favor different engines: random 64 and 32 bit integers, integers in a small range,
+// few distinct 64 bit values, a sorted array with a few elements appended, sorted shards that were
+// concatenated, sorted integers and random strings. The radix and counting engines are run through
+// pdqsort_detail directly, including the scan for the key range they need.
+//
+// Usage: auto [size ...]
+//
+// Output is one line per (size, input, algorithm): the median ns/element over one second of runs.
+// The line for pdqsort_auto also names the engine it chose.
+
+template<class T>
+double median_ns(const std::vector<T>& input, std::function<void(std::vector<T>&)> run) {
+    std::vector<double> ns;
+    std::vector<T> v;
+
+    auto total_start = std::chrono::steady_clock::now();
+    while (ns.size() < 3 ||
+           std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+        v = input;
+        auto start = std::chrono::steady_clock::now();
+        run(v);
+        auto end = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / v.size());
+    }
+
+    std::sort(ns.begin(), ns.end());
+    return ns[ns.size() / 2];
+}
+
+const char* engine_name(pdqsort_engine engine) {
+    switch (engine) {
+    case pdqsort_engine_none: return "none";
+    case pdqsort_engine_pdqsort: return "pdqsort";
+    case pdqsort_engine_append: return "append";
+    case pdqsort_engine_runs: return "runs";
+    case pdqsort_engine_counting: return "counting";
+    case pdqsort_engine_radix: return "radix";
+    }
+    return "?";
+}
+
+template<class T>
+std::pair<T, T> key_range(const std::vector<T>& v) {
+    auto minmax = std::minmax_element(v.begin(), v.end());
+    return std::make_pair(*minmax.first, *minmax.second);
+}
+
+template<class T>
+void radix(std::vector<T>& v) {
+    typedef pdqsort_detail::normalized_field<T> Field;
+    std::pair<T, T> range = key_range(v);
+    typename Field::U lo = Field::get(range.first);
+    pdqsort_detail::radix_sort(v.begin(), v.end(), lo, Field::get(range.second) - lo, false);
+}
+
+template<class T>
+void counting(std::vector<T>& v) {
+    typedef pdqsort_detail::normalized_field<T> Field;
+    std::pair<T, T> range = key_range(v);
+    typename Field::U lo = Field::get(range.first);
+    pdqsort_detail::counting_sort(v.begin(), v.end(), lo,
+                                  std::size_t(Field::get(range.second) - lo) + 1, false);
+}
+
+template<class T>
+void merge_runs(std::vector<T>& v) {
+    typedef typename std::vector<T>::iterator Iter;
+    std::vector<std::pair<Iter, Iter>> runs;
+    Iter begin = v.begin();
+    for (Iter it = v.begin() + 1; it != v.end(); ++it) {
+        if (*it < *(it - 1)) {
+            runs.push_back(std::make_pair(begin, it));
+            begin = it;
+        }
+    }
+    runs.push_back(std::make_pair(begin, v.end()));
+
+    std::vector<T> out(v.size());
+    pdq_merge_k(runs.begin(), runs.end(), out.begin());
+    v.swap(out);
+}
+
+template<class T>
+void append(std::vector<T>& v) {
+    auto mid = std::is_sorted_until(v.begin(), v.end());
+    pdqsort_append(v.begin(), mid, v.end());
+}
+
+template<class T>
+void bench(std::size_t size, const std::string& name, const std::vector<T>& input,
+           const std::vector<std::pair<std::string, std::function<void(std::vector<T>&)>>>& sorts) {
+    std::vector<T> v(input);
+    pdqsort_decision decision = pdqsort_auto(v.begin(), v.end());
+    std::cout << size << " " << name << " pdqsort_auto(" << engine_name(decision.engine) << ") "
+              << median_ns<T>(input, [](std::vector<T>& v) { pdqsort_auto(v.begin(), v.end()); })
+              << "\n";
+
+    std::cout << size << " " << name << " pdqsort "
+              << median_ns<T>(input, [](std::vector<T>& v) { pdqsort(v.begin(), v.end()); })
+              << "\n";
+    for (auto& sort : sorts) {
+        std::cout << size << " " << name << " " << sort.first << " "
+                  << median_ns<T>(input, sort.second) << "\n";
+    }
+}
+
+
+int main(int argc, char** argv) {
+    std::vector<std::size_t> sizes;
+    for (int i = 1; i < argc; ++i) sizes.push_back(std::size_t(std::atol(argv[i])));
+    if (sizes.empty()) sizes = {1000, 100000, 1000000};
+
+    typedef std::function<void(std::vector<uint64_t>&)> SortU64;
+    typedef std::function<void(std::vector<int>&)> SortInt;
+    std::vector<std::pair<std::string, SortU64>> radix_u64 = {{"radix", radix<uint64_t>}};
+    std::vector<std::pair<std::string, SortInt>> radix_int = {{"radix", radix<int>}};
+
+    std::mt19937_64 rng(42);
+    for (std::size_t size : sizes) {
+        std::vector<uint64_t> hashes(size);
+        for (auto& x : hashes) x = rng();
+        bench(size, "hashes", hashes, radix_u64);
+
+        std::vector<int> ints(size);
+        for (auto& x : ints) x = int(rng());
+        bench(size, "ints", ints, radix_int);
+
+        std::vector<int> small_range(size);
+        for (auto& x : small_range) x = int(rng() % 16);
+        bench<int>(size, "small_range", small_range,
+                   {{"counting", counting<int>}, {"radix", radix<int>}});
+
+        std::vector<uint64_t> few_distinct(size);
+        std::vector<uint64_t> values(16);
+        for (auto& x : values) x = rng();
+        for (auto& x : few_distinct) x = values[rng() % values.size()];
+        bench(size, "few_distinct", few_distinct, radix_u64);
+
+        std::vector<int> appended(ints);
+        std::sort(appended.begin(), appended.end() - size / 100);
+        bench<int>(size, "appended", appended, {{"append", append<int>}, {"radix", radix<int>}});
+
+        std::vector<int> shards(ints);
+        for (std::size_t i = 0; i < 8; ++i) {
+            std::sort(shards.begin() + i * size / 8, shards.begin() + (i + 1) * size / 8);
+        }
+        bench<int>(size, "shards", shards, {{"runs", merge_runs<int>}, {"radix", radix<int>}});
+
+        std::vector<int> sorted(ints);
+        std::sort(sorted.begin(), sorted.end());
+        bench(size, "sorted", sorted, radix_int);
+
+        std::vector<std::string> strings(size);
+        for (auto& x : strings) x = std::to_string(rng());
+        bench<std::string>(size, "strings", strings, {
+            {"std::sort", [](std::vector<std::string>& v) { std::sort(v.begin(), v.end()); }}
+        });
+    }
+
+    return 0;
+}
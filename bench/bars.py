@@ -17,9 +17,20 @@ distribution_names = {
     "descending_int": "Descending",
     "pipe_organ_int": "Pipe organ",
     "push_front_int": "Push front",
-    "push_middle_int": "Push middle"
+    "push_middle_int": "Push middle",
+    "zipf_int": "Zipf",
+    "sawtooth_int": "Sawtooth",
+    "sorted_runs_int": "Sorted runs",
+    "sorted_k_swaps_int": "Sorted (k swaps)",
+    "sorted_random_tail_int": "Sorted + random tail",
+    "mostly_equal_int": "Mostly equal",
+    "shared_high_bits_u64": "Shared high bits (u64)"
 }
 
+known_order = ("Shuffled", "Shuffled (16 values)", "All equal", "Ascending", "Descending",
+               "Pipe organ", "Push front", "Push middle", "Zipf", "Sawtooth", "Sorted runs",
+               "Sorted (k swaps)", "Sorted + random tail", "Mostly equal", "Shared high bits (u64)")
+
 sort_order = ["pdqsort", "std::sort", "std::stable_sort", "timsort", "std::sort_heap"]
 
 for filename in os.listdir("profiles"):
@@ -27,19 +38,24 @@ for filename in os.listdir("profiles"):
     for line in open(os.path.join("profiles", filename)):
         size, distribution, algo, *results = line.split()
         size = int(size)
-        distribution = distribution_names[distribution]
+        distribution = distribution_names.get(distribution, distribution)
         results = [int(result) for result in results]
         if not size in data: data[size] = {}
         if not distribution in data[size]: data[size][distribution] = {}
         data[size][distribution][algo] = results
 
     for size in data:
-        distributions = ("Shuffled", "Shuffled (16 values)", "All equal", "Ascending", "Descending",
-                        "Pipe organ", "Push front", "Push middle")
+        # Known distributions in a fixed order, followed by any others in the data, e.g. replays.
+        distributions = tuple(d for d in known_order if d in data[size])
+        distributions += tuple(sorted(d for d in data[size] if d not in known_order))
 
         algos = tuple(data[size]["Shuffled"].keys())
         algos = tuple(sorted(algos, key=lambda a: sort_order.index(a) if a in sort_order else 1000))
 
+        # Leave out distributions that weren't run for every algorithm.
+        distributions = tuple(d for d in distributions
+                              if d in data[size] and all(a in data[size][d] for a in algos))
+
         groupnames = distributions
         groupsize = len(algos)
         groups = [[data[size][distribution][algo] for algo in algos] for distribution in distributions]
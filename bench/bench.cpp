@@ -8,6 +8,19 @@
 #include <type_traits>
 #include <functional>
 #include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 #include "../pdqsort.h"
 #include "timsort.h"
@@ -89,6 +102,122 @@ std::vector<int> push_middle_int(int size, std::mt19937_64&) {
     return v;
 }
 
+// Zipf-skewed keys (s = 1) drawn from 2^16 distinct values, rank 0 being the most common.
+std::vector<int> zipf_int(int size, std::mt19937_64& rng) {
+    static std::vector<double> cdf;
+    if (cdf.empty()) {
+        double total = 0;
+        for (int k = 1; k <= (1 << 16); ++k) cdf.push_back(total += 1.0 / k);
+        for (auto& c : cdf) c /= total;
+    }
+
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::vector<int> v; v.reserve(size);
+    for (int i = 0; i < size; ++i) {
+        v.push_back(int(std::lower_bound(cdf.begin(), cdf.end(), u(rng)) - cdf.begin()));
+    }
+    return v;
+}
+
+std::vector<int> sawtooth_int(int size, std::mt19937_64&) {
+    std::vector<int> v; v.reserve(size);
+    int tooth = std::max(1, int(std::sqrt(double(size))));
+    for (int i = 0; i < size; ++i) v.push_back(i % tooth);
+    return v;
+}
+
+// Concatenation of 16 independently sorted runs of random values, like merged log shards.
+std::vector<int> sorted_runs_int(int size, std::mt19937_64& rng) {
+    std::vector<int> v; v.reserve(size);
+    for (int i = 0; i < size; ++i) v.push_back(int(rng() >> 33));
+    int runs = 16;
+    for (int r = 0; r < runs; ++r) {
+        std::sort(v.begin() + std::ptrdiff_t(size) * r / runs,
+                  v.begin() + std::ptrdiff_t(size) * (r + 1) / runs);
+    }
+    return v;
+}
+
+// Ascending sequence with sqrt(n) random pairs swapped.
+std::vector<int> sorted_k_swaps_int(int size, std::mt19937_64& rng) {
+    std::vector<int> v; v.reserve(size);
+    for (int i = 0; i < size; ++i) v.push_back(i);
+    std::uniform_int_distribution<int> idx(0, size - 1);
+    int swaps = int(std::sqrt(double(size)));
+    for (int i = 0; i < swaps; ++i) std::swap(v[idx(rng)], v[idx(rng)]);
+    return v;
+}
+
+// Ascending sequence followed by a tail of 1% random values.
+std::vector<int> sorted_random_tail_int(int size, std::mt19937_64& rng) {
+    std::vector<int> v; v.reserve(size);
+    int tail = std::max(1, size / 100);
+    for (int i = 0; i < size - tail; ++i) v.push_back(i);
+    std::uniform_int_distribution<int> val(0, size - 1);
+    for (int i = size - tail; i < size; ++i) v.push_back(val(rng));
+    return v;
+}
+
+// Almost all elements are equal, with 0.1% unique values sprinkled in.
+std::vector<int> mostly_equal_int(int size, std::mt19937_64& rng) {
+    std::vector<int> v; v.reserve(size);
+    int uniques = std::max(1, size / 1000);
+    for (int i = 0; i < size - uniques; ++i) v.push_back(size / 2);
+    for (int i = 0; i < uniques; ++i) v.push_back(i * 2);
+    std::shuffle(v.begin(), v.end(), rng);
+    return v;
+}
+
+// Random 64-bit values that all share the same top 40 bits, like hashes of a common prefix or
+// pointers from a single arena.
+std::vector<uint64_t> shared_high_bits_u64(int size, std::mt19937_64& rng) {
+    const uint64_t high = 0x5ca1ab1e00000000ull;
+    std::vector<uint64_t> v; v.reserve(size);
+    for (int i = 0; i < size; ++i) v.push_back(high | (rng() >> 40));
+    return v;
+}
+
+
+// Maps a binary dump of native-endian 32-bit integers into memory. Replayed distributions use a
+// prefix of the dump as input, so real data can be sorted at every benchmark size.
+std::pair<const int*, std::size_t> map_dump(const char* path) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) return std::make_pair((const int*) 0, std::size_t(0));
+    std::size_t n = std::size_t(st.st_size) / sizeof(int);
+    if (n == 0) { close(fd); return std::make_pair((const int*) 0, std::size_t(0)); }
+    void* p = mmap(0, n * sizeof(int), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return std::make_pair((const int*) 0, std::size_t(0));
+    return std::make_pair((const int*) p, n);
+#else
+    // No mmap, read the whole dump instead. It is intentionally leaked for the process lifetime.
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f) return std::make_pair((const int*) 0, std::size_t(0));
+    std::vector<int>* data = new std::vector<int>;
+    int buf[4096]; std::size_t got;
+    while ((got = std::fread(buf, sizeof(int), 4096, f)) > 0) data->insert(data->end(), buf, buf + got);
+    std::fclose(f);
+    return std::make_pair(data->data(), data->size());
+#endif
+}
+
+
+// Parses a --size argument into size. It must be a plain decimal number of at least 1 that fits in
+// an int, as the distributions generate int elements up to size.
+bool parse_size(const char* arg, int& size) {
+    char* end;
+    errno = 0;
+    unsigned long long value = std::strtoull(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || *arg == '-' || value == 0 || value > INT_MAX) {
+        return false;
+    }
+
+    size = int(value);
+    return true;
+}
+
 
 template<class Iter, class Compare>
 void heapsort(Iter begin, Iter end, Compare comp) {
@@ -98,14 +227,51 @@ void heapsort(Iter begin, Iter end, Compare comp) {
 
 
 
-int main() {
+template<class T, class Distr, class SortF>
+void bench(const std::string& distr_name, Distr distribution,
+           const std::string& sort_name, SortF sort, int size, std::mt19937_64& el) {
+    std::chrono::time_point<std::chrono::high_resolution_clock> total_start, total_end;
+    std::vector<uint64_t> cycles;
+
+    total_start = std::chrono::high_resolution_clock::now();
+    total_end = std::chrono::high_resolution_clock::now();
+    while (std::chrono::duration_cast<std::chrono::milliseconds>(total_end - total_start).count() < 5000) {
+        std::vector<T> v = distribution(size, el);
+        uint64_t start = rdtsc();
+        sort(v.begin(), v.end(), std::less<T>());
+        uint64_t end = rdtsc();
+        cycles.push_back(uint64_t(double(end - start) / v.size() + 0.5));
+        total_end = std::chrono::high_resolution_clock::now();
+        // if (!std::is_sorted(v.begin(), v.end())) {
+        //     std::cerr << "sort failed: ";
+        //     std::cerr << size << " " << distr_name << " " << sort_name << "\n";
+        // }
+    }
+
+    std::sort(cycles.begin(), cycles.end());
+
+    std::cerr << size << " " << distr_name << " " << sort_name
+              << " " << cycles[cycles.size()/2] << "\n";
+    std::cout << size << " " << distr_name << " " << sort_name
+              << " " << cycles[cycles.size()/2] << "\n";
+}
+
+
+// Usage: bench [--size n ...] [dump.bin ...]
+//
+// Every --size replaces the default sizes of 10^6 and 100, e.g. to see the effect of the memory
+// hierarchy on 10^8 or 10^9 elements. Every other argument is a binary dump of native-endian 32-bit
+// integers that gets replayed as an extra distribution named replay_<file name>.
+int main(int argc, char** argv) {
     auto seed = std::time(0);
     std::mt19937_64 el;
 
-    typedef std::vector<int> (*DistrF)(int, std::mt19937_64&);
+    typedef std::function<std::vector<int>(int, std::mt19937_64&)> DistrF;
     typedef void (*SortF)(std::vector<int>::iterator, std::vector<int>::iterator, std::less<int>);
+    typedef std::vector<uint64_t>::iterator U64Iter;
+    typedef void (*SortU64F)(U64Iter, U64Iter, std::less<uint64_t>);
 
-    std::pair<std::string, DistrF> distributions[] = {
+    std::vector<std::pair<std::string, DistrF>> distributions = {
         {"shuffled_int", shuffled_int},
         {"shuffled_16_values_int", shuffled_16_values_int},
         {"all_equal_int", all_equal_int},
@@ -113,51 +279,78 @@ int main() {
         {"descending_int", descending_int},
         {"pipe_organ_int", pipe_organ_int},
         {"push_front_int", push_front_int},
-        {"push_middle_int", push_middle_int}
+        {"push_middle_int", push_middle_int},
+        {"zipf_int", zipf_int},
+        {"sawtooth_int", sawtooth_int},
+        {"sorted_runs_int", sorted_runs_int},
+        {"sorted_k_swaps_int", sorted_k_swaps_int},
+        {"sorted_random_tail_int", sorted_random_tail_int},
+        {"mostly_equal_int", mostly_equal_int}
     };
 
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--size" && i + 1 < argc) {
+            int size;
+            if (!parse_size(argv[++i], size)) {
+                std::cerr << "invalid size " << argv[i] << ", expected an integer in [1, "
+                          << INT_MAX << "]\n";
+                return 1;
+            }
+
+            sizes.push_back(size);
+            continue;
+        }
+
+        std::pair<const int*, std::size_t> dump = map_dump(argv[i]);
+        if (!dump.first) {
+            std::cerr << "could not map " << argv[i] << "\n";
+            return 1;
+        }
+
+        std::string name = argv[i];
+        name = name.substr(name.find_last_of("/\\") + 1);
+        distributions.push_back({"replay_" + name, [dump](int size, std::mt19937_64&) {
+            return std::vector<int>(dump.first, dump.first + std::min(std::size_t(size), dump.second));
+        }});
+    }
+
     std::pair<std::string, SortF> sorts[] = {
         {"pdqsort", &pdqsort<std::vector<int>::iterator, std::less<int>>},
+        {"pdqsort_samplesort", &pdqsort_samplesort<std::vector<int>::iterator, std::less<int>>},
         {"std::sort", &std::sort<std::vector<int>::iterator, std::less<int>>},
         {"std::stable_sort", &std::stable_sort<std::vector<int>::iterator, std::less<int>>},
         // {"std::sort_heap", &heapsort<std::vector<int>::iterator, std::less<int>>},
         // {"timsort", &gfx::timsort<std::vector<int>::iterator, std::less<int>>}
     };
 
-    int sizes[] = {1000000, 100};
+    std::pair<std::string, SortU64F> sorts_u64[] = {
+        {"pdqsort", &pdqsort<U64Iter, std::less<uint64_t>>},
+        {"pdqsort_samplesort", &pdqsort_samplesort<U64Iter, std::less<uint64_t>>},
+        {"std::sort", &std::sort<U64Iter, std::less<uint64_t>>},
+        {"std::stable_sort", &std::stable_sort<U64Iter, std::less<uint64_t>>},
+    };
+
+    if (sizes.empty()) sizes = {1000000, 100};
 
     for (auto& distribution : distributions) {
         for (auto& sort : sorts) {
             el.seed(seed);
 
             for (auto size : sizes) {
-                std::chrono::time_point<std::chrono::high_resolution_clock> total_start, total_end;
-                std::vector<uint64_t> cycles;
-
-                total_start = std::chrono::high_resolution_clock::now();
-                total_end = std::chrono::high_resolution_clock::now();
-                while (std::chrono::duration_cast<std::chrono::milliseconds>(total_end - total_start).count() < 5000) {
-                    std::vector<int> v = distribution.second(size, el);
-                    uint64_t start = rdtsc();
-                    sort.second(v.begin(), v.end(), std::less<int>());
-                    uint64_t end = rdtsc();
-                    cycles.push_back(uint64_t(double(end - start) / size + 0.5));
-                    total_end = std::chrono::high_resolution_clock::now();
-                    // if (!std::is_sorted(v.begin(), v.end())) {
-                    //     std::cerr << "sort failed: ";
-                    //     std::cerr << size << " " << distribution.first << " " << sort.first << "\n";
-                    // }
-                }
-
-                std::sort(cycles.begin(), cycles.end());
-
-                std::cerr << size << " " << distribution.first << " " << sort.first
-                          << " " << cycles[cycles.size()/2] << "\n";
-                std::cout << size << " " << distribution.first << " " << sort.first
-                          << " " << cycles[cycles.size()/2] << "\n";
+                bench<int>(distribution.first, distribution.second, sort.first, sort.second, size, el);
             }
         }
     }
 
+    for (auto& sort : sorts_u64) {
+        el.seed(seed);
+
+        for (auto size : sizes) {
+            bench<uint64_t>("shared_high_bits_u64", shared_high_bits_u64,
+                            sort.first, sort.second, size, el);
+        }
+    }
+
     return 0;
 }
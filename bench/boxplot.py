@@ -13,15 +13,26 @@ distribution_names = {
     "descending_int": "Descending",
     "pipe_organ_int": "Pipe organ",
     "push_front_int": "Push front",
-    "push_middle_int": "Push middle"
+    "push_middle_int": "Push middle",
+    "zipf_int": "Zipf",
+    "sawtooth_int": "Sawtooth",
+    "sorted_runs_int": "Sorted runs",
+    "sorted_k_swaps_int": "Sorted (k swaps)",
+    "sorted_random_tail_int": "Sorted + random tail",
+    "mostly_equal_int": "Mostly equal",
+    "shared_high_bits_u64": "Shared high bits (u64)"
 }
 
+known_order = ("Shuffled", "Shuffled (16 values)", "All equal", "Ascending", "Descending",
+               "Pipe organ", "Push front", "Push middle", "Zipf", "Sawtooth", "Sorted runs",
+               "Sorted (k swaps)", "Sorted + random tail", "Mostly equal", "Shared high bits (u64)")
+
 for filename in os.listdir("profiles"):
     data = {}
     for line in open(os.path.join("profiles", filename)):
         size, distribution, algo, *results = line.split()
         size = int(size)
-        distribution = distribution_names[distribution]
+        distribution = distribution_names.get(distribution, distribution)
         results = [int(result) for result in results]
         if not size in data: data[size] = {}
         if not distribution in data[size]: data[size][distribution] = {}
@@ -34,11 +45,17 @@ for filename in os.listdir("profiles"):
         plt.setp(bp["medians"], color="black", linewidth=3, solid_capstyle="butt")
 
     size = 10**6
-    distributions = ("Shuffled", "Shuffled (16 values)", "All equal", "Ascending", "Descending", "Pipe organ", "Push front", "Push middle")
+    # Known distributions in a fixed order, followed by any others in the data, e.g. replays.
+    distributions = tuple(d for d in known_order if d in data[size])
+    distributions += tuple(sorted(d for d in data[size] if d not in known_order))
 
     algos = ("heapsort", "introsort", "pdqsort")
     if "timsort" in data[size]["Shuffled"]: algos += ("timsort",)
 
+    # Leave out distributions that weren't run for every algorithm.
+    distributions = tuple(d for d in distributions
+                          if d in data[size] and all(a in data[size][d] for a in algos))
+
     groupnames = distributions
     groupsize = len(algos)
     groups = [[data[size][distribution][algo] for algo in algos] for distribution in distributions]
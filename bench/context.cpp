@@ -0,0 +1,109 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+
+// Benchmarks many small sorts in a row, as done by services that sort thousands of times per
+// second, with and without a pdqsort_context that keeps the scratch memory between calls.
+//
+// Usage: context [size]
+//
+// Output is one line per (sort, variant): the median ns per sort over one second of runs, and the
+// heap allocations per sort made for scratch memory.
+
+struct Wide {
+    int key;
+    char payload[508];
+};
+
+struct WideLess {
+    bool operator()(const Wide& a, const Wide& b) const { return a.key < b.key; }
+};
+
+// Not detected as branchless, so pdqsort partitions in place with branches unless it gets a buffer.
+struct IntLess {
+    bool operator()(int a, int b) const { return a < b; }
+};
+
+// Sorting the same input over and over would let the branch predictor learn it, so every run takes
+// the next of a few different inputs.
+template<class T>
+void bench(const std::string& name, const std::vector<std::vector<T>>& inputs,
+           std::function<void(std::vector<T>&)> plain,
+           std::function<void(std::vector<T>&, pdqsort_context&)> with_context) {
+    pdqsort_context context;
+    for (int variant = 0; variant < 2; ++variant) {
+        std::vector<double> ns;
+        std::vector<T> v;
+        std::size_t allocations = context.stats().allocations;
+
+        auto total_start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+            v = inputs[ns.size() % inputs.size()];
+            auto start = std::chrono::steady_clock::now();
+            if (variant == 0) plain(v);
+            else with_context(v, context);
+            auto end = std::chrono::steady_clock::now();
+            ns.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        }
+
+        std::sort(ns.begin(), ns.end());
+        std::cout << name << (variant == 0 ? " " : " pdqsort_context ") << ns[ns.size() / 2];
+        if (variant == 1) {
+            std::cout << " " << double(context.stats().allocations - allocations) / ns.size();
+        }
+        std::cout << "\n";
+    }
+}
+
+
+int main(int argc, char** argv) {
+    std::size_t size = argc > 1 ? std::size_t(std::atol(argv[1])) : 10000;
+
+    std::mt19937_64 rng(42);
+    std::vector<std::vector<int>> ints(8, std::vector<int>(size));
+    std::vector<std::vector<Wide>> wides(8, std::vector<Wide>(size));
+    std::vector<std::vector<unsigned char>> records(8, std::vector<unsigned char>(size * 100));
+    for (int i = 0; i < 8; ++i) {
+        for (auto& x : ints[i]) x = int(rng());
+        for (auto& w : wides[i]) w.key = int(rng());
+        for (auto& b : records[i]) b = (unsigned char)(rng());
+    }
+
+    bench<int>("pdqsort", ints, [](std::vector<int>& v) {
+        pdqsort(v.begin(), v.end(), IntLess());
+    }, [](std::vector<int>& v, pdqsort_context& context) {
+        pdqsort(v.begin(), v.end(), IntLess(), context);
+    });
+    bench<Wide>("pdqsort_wide", wides, [](std::vector<Wide>& v) {
+        pdqsort(v.begin(), v.end(), WideLess());
+    }, [](std::vector<Wide>& v, pdqsort_context& context) {
+        pdqsort(v.begin(), v.end(), WideLess(), context);
+    });
+    bench<int>("pdqsort_indirect_by_key", ints, [](std::vector<int>& v) {
+        pdqsort_indirect_by_key(v.begin(), v.end(), [](int x) { return x; });
+    }, [](std::vector<int>& v, pdqsort_context& context) {
+        pdqsort_indirect_by_key(v.begin(), v.end(), [](int x) { return x; }, std::less<int>(),
+                                context);
+    });
+    bench<int>("pdqsort_samplesort", ints, [](std::vector<int>& v) {
+        pdqsort_samplesort(v.begin(), v.end(), std::less<int>());
+    }, [](std::vector<int>& v, pdqsort_context& context) {
+        pdqsort_samplesort(v.begin(), v.end(), std::less<int>(), context);
+    });
+    bench<unsigned char>("pdqsort_records", records, [size](std::vector<unsigned char>& v) {
+        pdqsort_records(v.data(), size, 100, 0, 10);
+    }, [size](std::vector<unsigned char>& v, pdqsort_context& context) {
+        pdqsort_records(v.data(), size, 100, 0, 10, context);
+    });
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+
+// Benchmarks sorting a copy of a read-only input, with std::copy followed by pdqsort against
+// pdqsort_copy, for integers, which are copied and sorted in place, and for strings, which are
+// partitioned while copying.
+//
+// Usage: copy [size ...]
+//
+// Output is one line per (size, distribution, algorithm): the median ns/element over one second
+// of runs.
+
+template<class T>
+double median_ns(const std::vector<T>& input,
+                 std::function<void(const std::vector<T>&, std::vector<T>&)> run) {
+    std::vector<double> ns;
+    std::vector<T> out(input.size());
+
+    auto total_start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+        auto start = std::chrono::steady_clock::now();
+        run(input, out);
+        auto end = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / input.size());
+    }
+
+    std::sort(ns.begin(), ns.end());
+    return ns[ns.size() / 2];
+}
+
+template<class T>
+void bench(std::size_t size, const std::string& name, const std::vector<T>& input) {
+    std::cout << size << " " << name << " std::copy+pdqsort "
+              << median_ns<T>(input, [](const std::vector<T>& in, std::vector<T>& out) {
+        std::copy(in.begin(), in.end(), out.begin());
+        pdqsort(out.begin(), out.end());
+    }) << "\n";
+    std::cout << size << " " << name << " pdqsort_copy "
+              << median_ns<T>(input, [](const std::vector<T>& in, std::vector<T>& out) {
+        pdqsort_copy(in.begin(), in.end(), out.begin());
+    }) << "\n";
+}
+
+
+int main(int argc, char** argv) {
+    std::vector<std::size_t> sizes;
+    for (int i = 1; i < argc; ++i) sizes.push_back(std::size_t(std::atol(argv[i])));
+    if (sizes.empty()) sizes = {1000, 100000, 1000000};
+
+    std::mt19937_64 rng(42);
+    for (auto size : sizes) {
+        std::vector<int> random(size);
+        for (auto& x : random) x = int(rng());
+        std::vector<int> few(size);
+        for (auto& x : few) x = int(rng() % 16);
+        std::vector<int> ascending(random);
+        std::sort(ascending.begin(), ascending.end());
+
+        std::pair<std::string, std::vector<int>*> distributions[] = {
+            {"random", &random}, {"random_16", &few}, {"ascending", &ascending}
+        };
+
+        for (auto& dist : distributions) {
+            bench(size, dist.first, *dist.second);
+
+            std::vector<std::string> strings(size);
+            for (std::size_t i = 0; i < size; ++i) strings[i] = std::to_string((*dist.second)[i]);
+            if (dist.second == &ascending) std::sort(strings.begin(), strings.end());
+            bench(size, dist.first + "_string", strings);
+        }
+    }
+
+    return 0;
+}
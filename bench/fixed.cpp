@@ -0,0 +1,69 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+
+// Benchmarks sorting many tiny arrays of a size known at compile time, such as k-NN candidate
+// lists, with pdqsort_fixed, pdqsort and std::sort.
+//
+// Usage: fixed [arrays]
+//
+// Output is one line per (size, algorithm): the median ns per array over one second of runs.
+
+template<std::size_t N>
+double median_ns(const std::vector<int>& input, std::function<void(std::vector<int>&)> run) {
+    std::vector<double> ns;
+    std::vector<int> v;
+
+    auto total_start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+        v = input;
+        auto start = std::chrono::steady_clock::now();
+        run(v);
+        auto end = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double, std::nano>(end - start).count();
+        ns.push_back(elapsed / (v.size() / N));
+    }
+
+    std::sort(ns.begin(), ns.end());
+    return ns[ns.size() / 2];
+}
+
+template<std::size_t N>
+void bench(std::size_t arrays, std::mt19937_64& rng) {
+    std::vector<int> input(arrays * N);
+    for (auto& x : input) x = int(rng());
+
+    std::cout << N << " pdqsort_fixed " << median_ns<N>(input, [](std::vector<int>& v) {
+        for (std::size_t i = 0; i < v.size(); i += N) pdqsort_fixed<N>(v.data() + i);
+    }) << "\n";
+    std::cout << N << " pdqsort " << median_ns<N>(input, [](std::vector<int>& v) {
+        for (std::size_t i = 0; i < v.size(); i += N) pdqsort(v.data() + i, v.data() + i + N);
+    }) << "\n";
+    std::cout << N << " std::sort " << median_ns<N>(input, [](std::vector<int>& v) {
+        for (std::size_t i = 0; i < v.size(); i += N) std::sort(v.data() + i, v.data() + i + N);
+    }) << "\n";
+}
+
+
+int main(int argc, char** argv) {
+    std::size_t arrays = argc > 1 ? std::size_t(std::atol(argv[1])) : 10000;
+    std::mt19937_64 rng(42);
+
+    bench<2>(arrays, rng);
+    bench<4>(arrays, rng);
+    bench<8>(arrays, rng);
+    bench<12>(arrays, rng);
+    bench<16>(arrays, rng);
+    bench<24>(arrays, rng);
+    bench<32>(arrays, rng);
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+
+// Benchmarks consuming the k smallest elements in sorted order when k isn't known in advance,
+// with pdqsort_incremental, against sorting everything with pdqsort and against std::partial_sort,
+// which does need k up front.
+//
+// Usage: incremental [size]
+//
+// Output is one line per (k, algorithm): the median ns per input element over one second of runs.
+
+typedef std::vector<int>::iterator Iter;
+
+double median_ns(const std::vector<int>& input, std::function<void(std::vector<int>&)> run) {
+    std::vector<double> ns;
+    std::vector<int> v;
+
+    auto total_start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+        v = input;
+        auto start = std::chrono::steady_clock::now();
+        run(v);
+        auto end = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / v.size());
+    }
+
+    std::sort(ns.begin(), ns.end());
+    return ns[ns.size() / 2];
+}
+
+
+int main(int argc, char** argv) {
+    std::size_t size = argc > 1 ? std::size_t(std::atol(argv[1])) : 1000000;
+
+    std::mt19937_64 rng(42);
+    std::vector<int> input(size);
+    for (auto& x : input) x = int(rng());
+
+    volatile int sink = 0;
+    for (std::size_t k = 10; k <= size; k *= 10) {
+        std::cout << k << " pdqsort_incremental " << median_ns(input, [&](std::vector<int>& v) {
+            pdqsort_incremental<Iter> view(v.begin(), v.end());
+            for (std::size_t i = 0; i < k; ++i) sink = *view.next();
+        }) << "\n";
+        std::cout << k << " pdqsort " << median_ns(input, [&](std::vector<int>& v) {
+            pdqsort(v.begin(), v.end());
+            for (std::size_t i = 0; i < k; ++i) sink = v[i];
+        }) << "\n";
+        std::cout << k << " std::partial_sort " << median_ns(input, [&](std::vector<int>& v) {
+            std::partial_sort(v.begin(), v.begin() + k, v.end());
+            for (std::size_t i = 0; i < k; ++i) sink = v[i];
+        }) << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,206 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <utility>
+#include <functional>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+
+// Microbenchmarks for the individual kernels in pdqsort_detail. Every kernel is run in isolation
+// over freshly prepared input, and the median time and branch misses per element are reported, so
+// a regression can be pinned on a single kernel rather than on the sort as a whole. heap_sort, the
+// worst case fallback, is shown next to the standard library heapsort it replaced.
+//
+// Usage: kernels [size]
+//
+// Output is one line per kernel: name, elements per run, ns/element and branch misses/element.
+// Branch misses are read from perf_event_open on Linux and reported as -1 elsewhere, or if the
+// counter isn't available (e.g. perf_event_paranoid forbids it).
+
+class BranchMissCounter {
+public:
+    BranchMissCounter() : fd(-1) {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~BranchMissCounter() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start() {
+#ifdef __linux__
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64_t stop() {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+#endif
+        return count;
+    }
+
+private:
+    int fd;
+};
+
+
+typedef std::vector<int>::iterator Iter;
+typedef pdqsort_detail::partition_block<int> Block;
+
+struct Kernel {
+    std::string name;
+    std::function<void(std::vector<int>&, std::mt19937_64&)> prepare;
+    std::function<void(std::vector<int>&)> run;
+};
+
+void fill_shuffled(std::vector<int>& v, std::mt19937_64& rng) {
+    for (std::size_t i = 0; i < v.size(); ++i) v[i] = int(i);
+    std::shuffle(v.begin(), v.end(), rng);
+}
+
+// Shuffled input with a median of 3 pivot at the front, as pdqsort_loop leaves it for partitioning.
+void fill_pivoted(std::vector<int>& v, std::mt19937_64& rng) {
+    fill_shuffled(v, rng);
+    std::size_t s2 = v.size() / 2;
+    pdqsort_detail::sort3(v.begin() + s2, v.begin(), v.end() - 1, std::less<int>());
+}
+
+// Shuffled input with many duplicates and a pivot at the front that is the minimum, the situation
+// in which pdqsort_loop calls partition_left.
+void fill_equal_pivot(std::vector<int>& v, std::mt19937_64& rng) {
+    for (std::size_t i = 0; i < v.size(); ++i) v[i] = int(i % 16);
+    std::shuffle(v.begin(), v.end(), rng);
+    v[0] = 0;
+}
+
+// Ascending input with a few elements displaced, so partial_insertion_sort succeeds.
+void fill_nearly_sorted(std::vector<int>& v, std::mt19937_64& rng) {
+    for (std::size_t i = 0; i < v.size(); ++i) v[i] = int(i);
+    std::uniform_int_distribution<std::size_t> idx(1, v.size() - 1);
+    std::size_t i = idx(rng);
+    std::swap(v[i - 1], v[i]);
+}
+
+
+int main(int argc, char** argv) {
+    std::size_t size = argc > 1 ? std::size_t(std::atol(argv[1])) : 1 << 16;
+    std::size_t small = pdqsort_detail::insertion_sort_threshold;
+    if (size < 3 * Block::size) size = 3 * Block::size;
+
+    std::less<int> comp;
+
+    // swap_offsets is fed a full block of offsets that all point at wrongly placed elements.
+    std::vector<Block::offset_type> offsets_l(Block::size);
+    std::vector<Block::offset_type> offsets_r(Block::size);
+    for (std::size_t i = 0; i < offsets_l.size(); ++i) {
+        offsets_l[i] = Block::offset_type(i);
+        offsets_r[i] = Block::offset_type(i + 1);
+    }
+
+    Kernel kernels[] = {
+        {"partition_right_branchless", fill_pivoted, [&](std::vector<int>& v) {
+            pdqsort_detail::partition_right_branchless(v.begin(), v.end(), comp);
+        }},
+        {"partition_right", fill_pivoted, [&](std::vector<int>& v) {
+            pdqsort_detail::partition_right(v.begin(), v.end(), comp);
+        }},
+        {"partition_left", fill_equal_pivot, [&](std::vector<int>& v) {
+            pdqsort_detail::partition_left(v.begin(), v.end(), comp);
+        }},
+        {"insertion_sort", [&](std::vector<int>& v, std::mt19937_64& rng) {
+            fill_shuffled(v, rng);
+        }, [&](std::vector<int>& v) {
+            for (Iter it = v.begin(); v.end() - it >= std::ptrdiff_t(small); it += small) {
+                pdqsort_detail::insertion_sort(it, it + small, comp);
+            }
+        }},
+        {"partial_insertion_sort", fill_nearly_sorted, [&](std::vector<int>& v) {
+            pdqsort_detail::partial_insertion_sort(v.begin(), v.end(), comp);
+        }},
+        {"heap_sort", fill_shuffled, [&](std::vector<int>& v) {
+            pdqsort_detail::heap_sort(v.begin(), v.end(), comp);
+        }},
+        {"std::make_heap+std::sort_heap", fill_shuffled, [&](std::vector<int>& v) {
+            std::make_heap(v.begin(), v.end(), comp);
+            std::sort_heap(v.begin(), v.end(), comp);
+        }},
+        {"sort3", fill_shuffled, [&](std::vector<int>& v) {
+            for (Iter it = v.begin(); v.end() - it >= 3; it += 3) {
+                pdqsort_detail::sort3(it, it + 1, it + 2, comp);
+            }
+        }},
+        {"swap_offsets", fill_shuffled, [&](std::vector<int>& v) {
+            std::size_t block = Block::size;
+            for (Iter it = v.begin(); v.end() - it >= std::ptrdiff_t(3 * block); it += 2 * block) {
+                pdqsort_detail::swap_offsets(it, it + 2 * block, offsets_l.data(), offsets_r.data(),
+                                             block, false);
+            }
+        }}
+    };
+
+    BranchMissCounter counter;
+    std::mt19937_64 rng(std::time(0));
+    std::vector<int> v(size);
+
+    for (auto& kernel : kernels) {
+        std::vector<double> ns;
+        std::vector<double> misses;
+
+        auto total_start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+            kernel.prepare(v, rng);
+
+            counter.start();
+            auto start = std::chrono::steady_clock::now();
+            kernel.run(v);
+            auto end = std::chrono::steady_clock::now();
+            uint64_t branch_misses = counter.stop();
+
+            ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / size);
+            misses.push_back(double(branch_misses) / size);
+        }
+
+        std::sort(ns.begin(), ns.end());
+        std::sort(misses.begin(), misses.end());
+
+        std::cout << kernel.name << " " << size << " " << ns[ns.size()/2] << " "
+                  << (counter.available() ? misses[misses.size()/2] : -1.0) << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <random>
+#include <vector>
+#include <queue>
+#include <iostream>
+#include <chrono>
+#include <utility>
+#include <functional>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+
+// Benchmarks merging k sorted runs of random integers with pdq_merge_k, against merging them
+// pairwise with std::merge in log2(k) passes and against a std::priority_queue of run heads.
+//
+// Usage: merge [size]
+//
+// Output is one line per (k, algorithm): the median ns per element over one second of runs.
+
+typedef std::vector<int>::iterator Iter;
+typedef std::pair<Iter, Iter> Range;
+
+double median_ns(std::size_t size, std::function<void()> run) {
+    std::vector<double> ns;
+
+    auto total_start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / size);
+    }
+
+    std::sort(ns.begin(), ns.end());
+    return ns[ns.size() / 2];
+}
+
+void merge_pairwise(std::vector<int>& data, std::vector<std::size_t> bounds,
+                    std::vector<int>& out) {
+    std::vector<int> tmp(data.size());
+    std::vector<int>* from = &data;
+    std::vector<int>* to = &tmp;
+    while (bounds.size() > 2) {
+        std::vector<std::size_t> merged;
+        for (std::size_t i = 0; i + 1 < bounds.size(); i += 2) {
+            merged.push_back(bounds[i]);
+            std::size_t mid = bounds[i + 1];
+            std::size_t end = i + 2 < bounds.size() ? bounds[i + 2] : mid;
+            std::merge(from->begin() + bounds[i], from->begin() + mid,
+                       from->begin() + mid, from->begin() + end, to->begin() + bounds[i]);
+        }
+        merged.push_back(bounds.back());
+        bounds.swap(merged);
+        std::swap(from, to);
+    }
+    std::copy(from->begin(), from->end(), out.begin());
+}
+
+void merge_heap(std::vector<Range> runs, std::vector<int>& out) {
+    typedef std::pair<int, std::size_t> Head;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heap;
+    for (std::size_t i = 0; i < runs.size(); ++i) {
+        if (runs[i].first != runs[i].second) heap.push(Head(*runs[i].first, i));
+    }
+
+    Iter o = out.begin();
+    while (!heap.empty()) {
+        std::size_t i = heap.top().second;
+        heap.pop();
+        *o++ = *runs[i].first;
+        if (++runs[i].first != runs[i].second) heap.push(Head(*runs[i].first, i));
+    }
+}
+
+
+int main(int argc, char** argv) {
+    std::size_t size = argc > 1 ? std::size_t(std::atol(argv[1])) : 1 << 22;
+    std::mt19937_64 rng(42);
+
+    std::vector<int> data(size);
+    std::vector<int> out(size);
+    for (std::size_t k = 2; k <= 1024; k *= 4) {
+        std::vector<std::size_t> bounds;
+        std::vector<Range> runs;
+        for (auto& x : data) x = int(rng());
+        for (std::size_t i = 0; i <= k; ++i) bounds.push_back(size * i / k);
+        for (std::size_t i = 0; i < k; ++i) {
+            std::sort(data.begin() + bounds[i], data.begin() + bounds[i + 1]);
+            runs.push_back(Range(data.begin() + bounds[i], data.begin() + bounds[i + 1]));
+        }
+
+        std::cout << k << " pdq_merge_k " << median_ns(size, [&] {
+            pdq_merge_k(runs.begin(), runs.end(), out.begin());
+        }) << "\n";
+        std::cout << k << " std::merge " << median_ns(size, [&] {
+            merge_pairwise(data, bounds, out);
+        }) << "\n";
+        std::cout << k << " std::priority_queue " << median_ns(size, [&] {
+            merge_heap(runs, out);
+        }) << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <utility>
+#include <functional>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+
+// Benchmarks pdq_partition against std::partition for predicates of varying selectivity, and
+// pdq_bucketize against bucketing with repeated std::partition and with std::sort on the bucket.
+//
+// Usage: partition [size]
+//
+// Output is one line per (benchmark, algorithm): the median ns/element over one second of runs.
+
+struct LessThan {
+    uint32_t threshold;
+    bool operator()(uint32_t x) const { return x < threshold; }
+};
+
+struct TopBits {
+    int shift;
+    std::size_t operator()(uint32_t x) const { return x >> shift; }
+};
+
+struct InBucket {
+    TopBits bucket;
+    std::size_t b;
+    bool operator()(uint32_t x) const { return bucket(x) == b; }
+};
+
+struct ByBucket {
+    TopBits bucket;
+    bool operator()(uint32_t a, uint32_t b) const { return bucket(a) < bucket(b); }
+};
+
+double median_ns(const std::vector<uint32_t>& input, std::function<void(std::vector<uint32_t>&)> run) {
+    std::vector<double> ns;
+    std::vector<uint32_t> v;
+
+    auto total_start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+        v = input;
+        auto start = std::chrono::steady_clock::now();
+        run(v);
+        auto end = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / v.size());
+    }
+
+    std::sort(ns.begin(), ns.end());
+    return ns[ns.size() / 2];
+}
+
+
+int main(int argc, char** argv) {
+    std::size_t size = argc > 1 ? std::size_t(std::atol(argv[1])) : 1000000;
+
+    std::mt19937_64 rng(42);
+    std::vector<uint32_t> input(size);
+    for (auto& x : input) x = uint32_t(rng());
+
+    for (double selectivity : {0.01, 0.5, 0.99}) {
+        LessThan pred = {uint32_t(selectivity * 4294967295.0)};
+        std::string name = "partition_" + std::to_string(int(selectivity * 100)) + "%";
+
+        std::cout << name << " pdq_partition " << median_ns(input, [&](std::vector<uint32_t>& v) {
+            pdq_partition(v.begin(), v.end(), pred);
+        }) << "\n";
+        std::cout << name << " std::partition " << median_ns(input, [&](std::vector<uint32_t>& v) {
+            std::partition(v.begin(), v.end(), pred);
+        }) << "\n";
+    }
+
+    for (int k : {4, 16, 256}) {
+        TopBits bucket = {32 - pdqsort_detail::log2(k)};
+        std::string name = "bucketize_" + std::to_string(k);
+
+        std::cout << name << " pdq_bucketize " << median_ns(input, [&](std::vector<uint32_t>& v) {
+            pdq_bucketize(v.begin(), v.end(), bucket, k);
+        }) << "\n";
+        std::cout << name << " std::partition " << median_ns(input, [&](std::vector<uint32_t>& v) {
+            auto it = v.begin();
+            for (int b = 0; b + 1 < k; ++b) it = std::partition(it, v.end(), InBucket{bucket, std::size_t(b)});
+        }) << "\n";
+        std::cout << name << " pdqsort " << median_ns(input, [&](std::vector<uint32_t>& v) {
+            pdqsort(v.begin(), v.end(), ByBucket{bucket});
+        }) << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+
+// Benchmarks sorting 100 byte records with 10 byte keys in the gensort format used by the TeraSort
+// and sortbenchmark.org benchmarks: pdqsort_records against std::sort and pdqsort on a struct
+// wrapping the record, compared with memcmp on the key.
+//
+// Usage: records [file | num_records]
+//
+// A file must hold whole records, e.g. written by gensort. Otherwise num_records records (default
+// 10^6) with random keys are generated in the same layout. Output is one line per algorithm: the
+// number of records and the median ns/record over one second of runs.
+
+enum { record_size = 100, key_size = 10 };
+
+struct Record {
+    unsigned char bytes[record_size];
+};
+
+struct KeyLess {
+    bool operator()(const Record& a, const Record& b) const {
+        return std::memcmp(a.bytes, b.bytes, key_size) < 0;
+    }
+};
+
+// Random records laid out like gensort's binary records: a 10 byte key, the bytes 00 11, the record
+// number as 32 hex digits, the bytes 88 99 AA BB, 48 filler bytes and the bytes CC DD EE FF.
+std::vector<Record> generate(std::size_t num_records) {
+    static const unsigned char breaks[3][4] = {
+        {0x00, 0x11}, {0x88, 0x99, 0xAA, 0xBB}, {0xCC, 0xDD, 0xEE, 0xFF}
+    };
+
+    std::mt19937_64 rng(42);
+    std::vector<Record> records(num_records);
+    for (std::size_t i = 0; i < num_records; ++i) {
+        unsigned char* r = records[i].bytes;
+        for (int j = 0; j < key_size; ++j) r[j] = (unsigned char)(rng());
+        std::memcpy(r + 10, breaks[0], 2);
+        char hex[33];
+        std::snprintf(hex, sizeof(hex), "%032llX", (unsigned long long)(i));
+        std::memcpy(r + 12, hex, 32);
+        std::memcpy(r + 44, breaks[1], 4);
+        std::memset(r + 48, 'A' + int(i % 26), 48);
+        std::memcpy(r + 96, breaks[2], 4);
+    }
+    return records;
+}
+
+std::vector<Record> load(const char* path) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<Record> records;
+    Record record;
+    while (in.read(reinterpret_cast<char*>(record.bytes), record_size)) records.push_back(record);
+    return records;
+}
+
+double median_ns(const std::vector<Record>& input, std::function<void(std::vector<Record>&)> run) {
+    std::vector<double> ns;
+    std::vector<Record> v;
+
+    auto total_start = std::chrono::steady_clock::now();
+    while (ns.size() < 3 ||
+           std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+        v = input;
+        auto start = std::chrono::steady_clock::now();
+        run(v);
+        auto end = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / v.size());
+    }
+
+    std::sort(ns.begin(), ns.end());
+    return ns[ns.size() / 2];
+}
+
+
+int main(int argc, char** argv) {
+    std::vector<Record> input;
+    std::ifstream probe(argc > 1 ? argv[1] : "");
+    if (probe) input = load(argv[1]);
+    else input = generate(argc > 1 ? std::size_t(std::atol(argv[1])) : 1000000);
+    if (input.empty()) return 1;
+
+    std::cout << input.size() << " pdqsort_records "
+              << median_ns(input, [](std::vector<Record>& v) {
+        pdqsort_records(v.data(), v.size(), record_size, 0, key_size);
+    }) << "\n";
+    std::cout << input.size() << " pdqsort "
+              << median_ns(input, [](std::vector<Record>& v) {
+        pdqsort(v.begin(), v.end(), KeyLess());
+    }) << "\n";
+    std::cout << input.size() << " std::sort "
+              << median_ns(input, [](std::vector<Record>& v) {
+        std::sort(v.begin(), v.end(), KeyLess());
+    }) << "\n";
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+
+// Benchmarks the overhead of sorting in slices with pdqsort_resumable, for step budgets of 10^3 up
+// to 10^6, against a single pdqsort call, on random, ascending and descending integers.
+//
+// Usage: resumable [size]
+//
+// Output is one line per (distribution, algorithm): the median ns per element over one second of
+// runs, followed by the median over those runs of the longest single call in ns.
+
+typedef std::vector<int>::iterator Iter;
+
+// Run sorts v, calling slice around every separately timed call it makes.
+typedef std::function<void(std::vector<int>&, std::function<void(std::function<void()>)>)> Run;
+
+void median_ns(const std::vector<int>& input, Run run, double& per_element, double& worst_call) {
+    std::vector<double> ns;
+    std::vector<double> worst;
+    std::vector<int> v;
+
+    auto total_start = std::chrono::steady_clock::now();
+    while (ns.size() < 3 ||
+           std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+        v = input;
+        double longest = 0;
+        auto start = std::chrono::steady_clock::now();
+        run(v, [&](std::function<void()> call) {
+            auto call_start = std::chrono::steady_clock::now();
+            call();
+            auto call_end = std::chrono::steady_clock::now();
+            longest = std::max(longest,
+                std::chrono::duration<double, std::nano>(call_end - call_start).count());
+        });
+        auto end = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / v.size());
+        worst.push_back(longest);
+    }
+
+    std::sort(ns.begin(), ns.end());
+    std::sort(worst.begin(), worst.end());
+    per_element = ns[ns.size() / 2];
+    worst_call = worst[worst.size() / 2];
+}
+
+
+int main(int argc, char** argv) {
+    std::size_t size = argc > 1 ? std::size_t(std::atol(argv[1])) : 1000000;
+
+    std::mt19937_64 rng(42);
+    std::vector<std::pair<std::string, std::vector<int>>> distributions(3);
+    distributions[0].first = "random";
+    distributions[1].first = "ascending";
+    distributions[2].first = "descending";
+    for (std::size_t i = 0; i < size; ++i) {
+        distributions[0].second.push_back(int(rng()));
+        distributions[1].second.push_back(int(i));
+        distributions[2].second.push_back(int(size - i));
+    }
+
+    for (auto& distribution : distributions) {
+        double per_element, worst_call;
+        for (std::size_t budget = 1000; budget <= 1000000; budget *= 10) {
+            median_ns(distribution.second, [&](std::vector<int>& v,
+                                               std::function<void(std::function<void()>)> slice) {
+                pdqsort_resumable<Iter> sorter(v.begin(), v.end());
+                bool done = false;
+                while (!done) slice([&] { done = sorter.step(budget); });
+            }, per_element, worst_call);
+            std::cout << distribution.first << " pdqsort_resumable_" << budget << " "
+                      << per_element << " " << worst_call << "\n";
+        }
+
+        median_ns(distribution.second, [](std::vector<int>& v,
+                                           std::function<void(std::function<void()>)> slice) {
+            slice([&] { pdqsort(v.begin(), v.end()); });
+        }, per_element, worst_call);
+        std::cout << distribution.first << " pdqsort " << per_element << " " << worst_call << "\n";
+    }
+
+    return 0;
+}
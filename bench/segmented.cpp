@@ -0,0 +1,74 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../pdqsort.h"
+
+
+// Benchmarks sorting many small segments stored back to back with pdqsort_segmented, against
+// calling pdqsort on every segment, for segments of 2 to 32 random integers and for segments of
+// mixed sizes drawn uniformly from that range.
+//
+// Usage: segmented [size]
+//
+// Output is one line per (segment size, algorithm): the median ns per element over one second of
+// runs. The segment size is "mixed" for the mixed sizes.
+
+double median_ns(const std::vector<int>& input, std::function<void(std::vector<int>&)> run) {
+    std::vector<double> ns;
+    std::vector<int> v;
+
+    auto total_start = std::chrono::steady_clock::now();
+    while (ns.size() < 3 ||
+           std::chrono::steady_clock::now() - total_start < std::chrono::seconds(1)) {
+        v = input;
+        auto start = std::chrono::steady_clock::now();
+        run(v);
+        auto end = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / v.size());
+    }
+
+    std::sort(ns.begin(), ns.end());
+    return ns[ns.size() / 2];
+}
+
+void bench(const std::string& name, const std::vector<int>& input,
+           const std::vector<std::size_t>& offsets) {
+    std::size_t num_segments = offsets.size() - 1;
+    std::cout << name << " pdqsort_segmented " << median_ns(input, [&](std::vector<int>& v) {
+        pdqsort_segmented(v.begin(), offsets.begin(), num_segments);
+    }) << "\n";
+    std::cout << name << " pdqsort " << median_ns(input, [&](std::vector<int>& v) {
+        for (std::size_t i = 0; i < num_segments; ++i) {
+            pdqsort(v.begin() + offsets[i], v.begin() + offsets[i + 1]);
+        }
+    }) << "\n";
+}
+
+
+int main(int argc, char** argv) {
+    std::size_t size = argc > 1 ? std::size_t(std::atol(argv[1])) : 1000000;
+
+    std::mt19937_64 rng(42);
+    std::vector<int> input(size);
+    for (auto& x : input) x = int(rng());
+
+    for (std::size_t segment_size = 2; segment_size <= 32; ++segment_size) {
+        std::vector<std::size_t> offsets;
+        for (std::size_t i = 0; i + segment_size <= size; i += segment_size) offsets.push_back(i);
+        offsets.push_back(offsets.back() + segment_size);
+        bench(std::to_string(segment_size), input, offsets);
+    }
+
+    std::vector<std::size_t> offsets(1, 0);
+    while (offsets.back() + 32 <= size) offsets.push_back(offsets.back() + 2 + rng() % 31);
+    bench("mixed", input, offsets);
+
+    return 0;
+}
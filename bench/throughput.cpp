@@ -0,0 +1,152 @@
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <utility>
+#include <functional>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+
+#include "../pdqsort.h"
+#include "timsort.h"
+
+
+// Concurrent throughput benchmark. Every thread repeatedly sorts its own shuffled arrays, so that
+// memory bandwidth and shared cache contention are part of the measurement, like they are in a
+// service that runs many independent sorts on all cores at once.
+//
+// Usage: throughput [threads] [seconds] [size ...]
+//
+// Output is one line per (size, sort): the aggregate sorted elements per second over all threads
+// and the p50, p99 and p999 latency of a single sort in nanoseconds.
+
+typedef std::vector<int>::iterator Iter;
+typedef void (*SortF)(Iter, Iter, std::less<int>);
+
+struct Result {
+    uint64_t elements;
+    std::vector<uint64_t> latencies;
+};
+
+void worker(SortF sort, int size, std::chrono::steady_clock::time_point deadline,
+            const std::atomic<bool>* go, uint64_t seed, Result* result) {
+    std::mt19937_64 rng(seed);
+
+    // A handful of distinct inputs per thread, so the branch predictor can't learn a single one.
+    std::vector<std::vector<int>> inputs(8);
+    for (auto& input : inputs) {
+        input.reserve(size);
+        for (int i = 0; i < size; ++i) input.push_back(int(rng() >> 33));
+    }
+
+    std::vector<int> v(size);
+    result->elements = 0;
+    while (!go->load(std::memory_order_acquire)) std::this_thread::yield();
+
+    for (std::size_t iter = 0; std::chrono::steady_clock::now() < deadline; ++iter) {
+        const std::vector<int>& input = inputs[iter % inputs.size()];
+        std::copy(input.begin(), input.end(), v.begin());
+
+        auto start = std::chrono::steady_clock::now();
+        sort(v.begin(), v.end(), std::less<int>());
+        auto end = std::chrono::steady_clock::now();
+
+        result->latencies.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        result->elements += size;
+    }
+}
+
+// Parses a thread count, number of seconds or size argument into value. It must be a plain decimal
+// number of at least 1 that fits in an int.
+bool parse_count(const char* arg, int& value) {
+    char* end;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || *arg == '-' || parsed == 0 ||
+        parsed > INT_MAX) {
+        return false;
+    }
+
+    value = int(parsed);
+    return true;
+}
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    std::size_t i = std::size_t(p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+
+int main(int argc, char** argv) {
+    // hardware_concurrency may return 0 if it can't tell.
+    int num_threads = std::max(1, int(std::thread::hardware_concurrency()));
+    int seconds = 5;
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; ++i) {
+        const char* what = i == 1 ? "thread count" : i == 2 ? "number of seconds" : "size";
+        int value;
+        if (!parse_count(argv[i], value)) {
+            std::cerr << "invalid " << what << " " << argv[i] << ", expected an integer in [1, "
+                      << INT_MAX << "]\n";
+            return 1;
+        }
+
+        if (i == 1) num_threads = value;
+        else if (i == 2) seconds = value;
+        else sizes.push_back(value);
+    }
+    if (sizes.empty()) sizes = {1000, 10000, 100000};
+
+    std::pair<std::string, SortF> sorts[] = {
+        {"pdqsort", &pdqsort<Iter, std::less<int>>},
+        {"pdqsort_branchless", &pdqsort_branchless<Iter, std::less<int>>},
+        {"std::sort", &std::sort<Iter, std::less<int>>},
+        {"timsort", &gfx::timsort<Iter, std::less<int>>}
+    };
+
+    for (auto size : sizes) {
+        for (auto& sort : sorts) {
+            std::vector<Result> results(num_threads);
+            std::vector<std::thread> threads;
+            std::atomic<bool> go(false);
+
+            // The deadline is set generously ahead so input generation isn't timed, then threads
+            // are released all at once.
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds + 1);
+            for (int t = 0; t < num_threads; ++t) {
+                threads.emplace_back(worker, sort.second, size, deadline, &go, uint64_t(t + 1),
+                                     &results[t]);
+            }
+
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            auto start = std::chrono::steady_clock::now();
+            go.store(true, std::memory_order_release);
+            for (auto& thread : threads) thread.join();
+            auto end = std::chrono::steady_clock::now();
+
+            uint64_t elements = 0;
+            std::vector<uint64_t> latencies;
+            for (auto& result : results) {
+                elements += result.elements;
+                latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+            }
+            std::sort(latencies.begin(), latencies.end());
+
+            double elapsed = std::chrono::duration<double>(end - start).count();
+            std::cout << size << " " << sort.first << " " << num_threads
+                      << " " << uint64_t(elements / elapsed)
+                      << " " << percentile(latencies, 0.5)
+                      << " " << percentile(latencies, 0.99)
+                      << " " << percentile(latencies, 0.999) << "\n";
+        }
+    }
+
+    return 0;
+}
@@ -28,15 +28,207 @@
 #include <functional>
 #include <utility>
 #include <iterator>
+#include <new>
 
 #if __cplusplus >= 201103L
+    #include <array>
     #include <cstdint>
+    #include <cstring>
+    #include <limits>
+    #include <tuple>
     #include <type_traits>
     #define PDQSORT_PREFER_MOVE(x) std::move(x)
 #else
     #define PDQSORT_PREFER_MOVE(x) (x)
 #endif
 
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+    #include <coroutine>
+#endif
+
+// In C++20 pdqsort can be used in constant expressions, e.g. to sort lookup tables at compile
+// time. Branchless partitioning isn't possible there, so it's only used at runtime.
+#if __cplusplus >= 202002L && defined(__cpp_lib_is_constant_evaluated)
+    #define PDQSORT_CONSTEXPR constexpr
+    #define PDQSORT_IS_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#else
+    #define PDQSORT_CONSTEXPR
+    #define PDQSORT_IS_CONSTANT_EVALUATED() false
+#endif
+
+
+class pdqsort_context;
+
+#if __cplusplus >= 201103L
+// Where pdqsort_float puts NaNs. pdqsort_total_order sorts by IEEE 754 totalOrder instead, which
+// puts negative NaNs first, positive NaNs last and -0 before +0.
+enum pdqsort_nan_policy {
+    pdqsort_nans_first,
+    pdqsort_nans_last,
+    pdqsort_total_order
+};
+
+// Marks a field of a pdqsort_packed key as sorted in descending order.
+template<class T>
+struct pdqsort_descending_key {
+    T value;
+};
+
+template<class T>
+inline pdqsort_descending_key<T> pdqsort_descending(T value) {
+    pdqsort_descending_key<T> key = { value };
+    return key;
+}
+
+// The engines pdqsort_auto chooses between.
+enum pdqsort_engine {
+    // The input was already sorted, nothing was done.
+    pdqsort_engine_none,
+
+    // Sorted by pdqsort.
+    pdqsort_engine_pdqsort,
+
+    // A long sorted prefix, the rest was sorted and merged in by pdqsort_append.
+    pdqsort_engine_append,
+
+    // A few sorted runs, merged by pdq_merge_k.
+    pdqsort_engine_runs,
+
+    // Integers or enums in a small range, sorted by counting how often every value occurs.
+    pdqsort_engine_counting,
+
+    // Integers or enums, sorted by LSD radix sort on the bytes in which they differ.
+    pdqsort_engine_radix
+};
+
+// What pdqsort_auto found out about its input, and the engine it chose based on that. The input is
+// only looked at as far as needed to decide, fields that weren't needed are 0 (key_bits -1).
+struct pdqsort_decision {
+    pdqsort_engine engine;
+    std::size_t size;
+
+    // Length of the sorted prefix, and the number of sorted runs if there are at most
+    // pdqsort_detail::auto_max_runs.
+    std::size_t sorted_prefix;
+    std::size_t runs;
+
+    // Number of distinct values among sample_size evenly spaced elements.
+    std::size_t sample_size;
+    std::size_t sample_distinct;
+
+    // Number of bits in which the smallest and largest key differ, for integers and enums sorted by
+    // std::less or std::greater.
+    int key_bits;
+};
+
+namespace pdqsort_detail {
+    template<class T> struct nothrow_buffer;
+    inline void count_sort(pdqsort_context& context, std::size_t size);
+}
+
+template<class RangeIter, class OutIter, class Compare>
+inline OutIter pdq_merge_k(RangeIter ranges_begin, RangeIter ranges_end, OutIter out,
+                           Compare comp);
+
+// Counters accumulated by a pdqsort_context over the sorts it was passed to.
+struct pdqsort_stats {
+    std::size_t sorts;
+    std::size_t elements;
+
+    // Heap allocations made for scratch memory, and the most scratch memory one sort needed.
+    std::size_t allocations;
+    std::size_t peak_scratch_bytes;
+};
+
+// Scratch memory that is kept between sorts, for callers that sort often. The overloads that take a
+// context, and would otherwise allocate, take their index arrays and buffers from it instead. It
+// grows to the most memory any single sort needed, so once it has seen the largest sort no more
+// allocations are made. A context must not be used by more than one sort at a time.
+class pdqsort_context {
+public:
+    pdqsort_context() : arena(0), capacity(0), used(0), demand(0), peak(0) { reset_stats(); }
+    ~pdqsort_context() { ::operator delete(arena); }
+
+    // Allocates bytes of scratch memory up front, so sorts needing at most that never allocate.
+    void reserve(std::size_t bytes) {
+        if (bytes > capacity && demand == 0) grow(bytes);
+    }
+
+    // Frees the scratch memory.
+    void shrink() {
+        if (demand != 0) return;
+        ::operator delete(arena);
+        arena = 0;
+        capacity = 0;
+    }
+
+    std::size_t scratch_bytes() const { return capacity; }
+    const pdqsort_stats& stats() const { return counters; }
+
+    void reset_stats() {
+        pdqsort_stats zero = { 0, 0, 0, 0 };
+        counters = zero;
+    }
+
+private:
+    template<class T> friend struct pdqsort_detail::nothrow_buffer;
+    friend void pdqsort_detail::count_sort(pdqsort_context& context, std::size_t size);
+
+    enum { alignment = 64 };
+
+    pdqsort_context(const pdqsort_context&);
+    pdqsort_context& operator=(const pdqsort_context&);
+
+    // Hands out scratch memory in stack order from the arena. What doesn't fit is allocated, and
+    // the arena is grown to fit it next time once the sort is done with it. Returns null if that
+    // allocation fails.
+    void* acquire(std::size_t bytes) {
+        bytes = (bytes + alignment - 1) / alignment * alignment;
+        if (demand == 0 && bytes > capacity) grow(bytes);
+        demand += bytes;
+        if (demand > peak) peak = demand;
+
+        if (capacity - used >= bytes) {
+            void* p = arena + used;
+            used += bytes;
+            return p;
+        }
+
+        ++counters.allocations;
+        return ::operator new(bytes, std::nothrow);
+    }
+
+    void release(void* p, std::size_t bytes) {
+        bytes = (bytes + alignment - 1) / alignment * alignment;
+        demand -= bytes;
+        std::less<const void*> less;
+        if (!less(p, arena) && less(p, arena + capacity)) {
+            used -= bytes;
+        } else ::operator delete(p);
+
+        if (demand == 0) {
+            if (peak > counters.peak_scratch_bytes) counters.peak_scratch_bytes = peak;
+            if (peak > capacity) grow(peak);
+            peak = 0;
+        }
+    }
+
+    void grow(std::size_t bytes) {
+        ::operator delete(arena);
+        arena = static_cast<char*>(::operator new(bytes, std::nothrow));
+        capacity = arena ? bytes : 0;
+        ++counters.allocations;
+    }
+
+    char* arena;
+    std::size_t capacity;
+    std::size_t used;
+    std::size_t demand;
+    std::size_t peak;
+    pdqsort_stats counters;
+};
+#endif
+
 
 namespace pdqsort_detail {
     enum {
@@ -50,23 +242,83 @@ namespace pdqsort_detail {
         // amount of element moves before giving up.
         partial_insertion_sort_limit = 8,
 
-        // Must be multiple of 8 due to loop unrolling, and < 256 to fit in unsigned char.
-        block_size = 64,
-
         // Cacheline size, assumes power of two.
-        cacheline_size = 64
+        cacheline_size = 64,
+
+        // Element types larger than this many bytes are sorted indirectly by pdqsort: an array of
+        // indices is sorted instead, after which every element is moved exactly once.
+        indirect_sort_threshold = 256,
+
+        // pdqsort_samplesort distributes ranges larger than this into buckets before sorting.
+        samplesort_threshold = 1 << 16,
+
+        // Number of buckets samplesort distributes into is 2^samplesort_log_buckets. With equality
+        // buckets there are twice as many, which must fit in an unsigned char.
+        samplesort_log_buckets = 7,
+
+        // Samplesort picks splitters from a sorted sample of this many elements per bucket.
+        samplesort_oversampling = 16,
+
+        // pdqsort_fixed sorts up to this many elements with a sorting network, more with pdqsort.
+        fixed_network_max_size = 32,
+
+        // pdq_merge_k and pdq_merge_k_split keep their per range state on the stack for up to this
+        // many ranges, and allocate it for more.
+        merge_k_stack_ranges = 64,
+
+        // pdqsort_auto sorts ranges smaller than this with pdqsort without looking at them.
+        auto_threshold = 256,
+
+        // pdqsort_auto merges up to this many sorted runs, and merges a sorted prefix with the rest
+        // if that rest is at most 1 / auto_append_ratio of the range.
+        auto_max_runs = 16,
+        auto_append_ratio = 4,
+
+        // pdqsort_auto counts distinct values among this many elements, and considers the input to
+        // have few distinct values, which pdqsort handles well, if at most auto_few_distinct are.
+        auto_sample_size = 64,
+        auto_few_distinct = 32,
+
+        // Integers whose keys span at most this many values and at most one per element are
+        // counted. Others are radix sorted if there are at least radix_sort_threshold and their
+        // keys differ in at most radix_sort_max_bytes bytes, beyond which the passes cost more
+        // than pdqsort.
+        counting_sort_max_range = 1 << 16,
+        radix_sort_threshold = 1 << 10,
+        radix_sort_max_bytes = 4
 
     };
 
 #if __cplusplus >= 201103L
+    // Comparators that compare with the built-in operators. This includes the transparent
+    // std::less<> and std::greater<>, which are std::less<void> and std::greater<void>.
     template<class T> struct is_default_compare : std::false_type { };
     template<class T> struct is_default_compare<std::less<T>> : std::true_type { };
     template<class T> struct is_default_compare<std::greater<T>> : std::true_type { };
+#if defined(__cpp_lib_ranges) && __cpp_lib_ranges >= 201911L
+    template<> struct is_default_compare<std::ranges::less> : std::true_type { };
+    template<> struct is_default_compare<std::ranges::greater> : std::true_type { };
+#endif
+
+    // Types for which the built-in comparison operators compile to branchless code: arithmetic
+    // types, pointers and enums, and pairs and tuples consisting of those.
+    template<class T> struct is_branchless_key
+        : std::integral_constant<bool, std::is_arithmetic<T>::value || std::is_pointer<T>::value ||
+                                       std::is_enum<T>::value> { };
+
+    template<class A, class B> struct is_branchless_key<std::pair<A, B>>
+        : std::integral_constant<bool, is_branchless_key<A>::value &&
+                                       is_branchless_key<B>::value> { };
+
+    template<class... Ts> struct is_branchless_key<std::tuple<Ts...>> : std::true_type { };
+    template<class T, class... Ts> struct is_branchless_key<std::tuple<T, Ts...>>
+        : std::integral_constant<bool, is_branchless_key<T>::value &&
+                                       is_branchless_key<std::tuple<Ts...>>::value> { };
 #endif
 
     // Returns floor(log2(n)), assumes n > 0.
     template<class T>
-    inline int log2(T n) {
+    inline PDQSORT_CONSTEXPR int log2(T n) {
         int log = 0;
         while (n >>= 1) ++log;
         return log;
@@ -74,7 +326,7 @@ namespace pdqsort_detail {
 
     // Sorts [begin, end) using insertion sort with the given comparison function.
     template<class Iter, class Compare>
-    inline void insertion_sort(Iter begin, Iter end, Compare comp) {
+    inline PDQSORT_CONSTEXPR void insertion_sort(Iter begin, Iter end, Compare comp) {
         typedef typename std::iterator_traits<Iter>::value_type T;
         if (begin == end) return;
 
@@ -97,7 +349,7 @@ namespace pdqsort_detail {
     // Sorts [begin, end) using insertion sort with the given comparison function. Assumes
     // *(begin - 1) is an element smaller than or equal to any element in [begin, end).
     template<class Iter, class Compare>
-    inline void unguarded_insertion_sort(Iter begin, Iter end, Compare comp) {
+    inline PDQSORT_CONSTEXPR void unguarded_insertion_sort(Iter begin, Iter end, Compare comp) {
         typedef typename std::iterator_traits<Iter>::value_type T;
         if (begin == end) return;
 
@@ -117,11 +369,51 @@ namespace pdqsort_detail {
         }
     }
 
+    // Sorts [begin, end) using insertion sort without data dependent branches. Every element is
+    // compared against the whole sorted prefix instead of stopping at its position, so this does
+    // O(n^2) comparisons and is only worth it for tiny ranges with cheap, branchless comparisons.
+    template<class Iter, class Compare>
+    inline PDQSORT_CONSTEXPR void branchless_insertion_sort(Iter begin, Iter end, Compare comp) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+        if (begin == end) return;
+
+        for (Iter cur = begin + 1; cur != end; ++cur) {
+            T x = *cur;
+
+            // The prefix is sorted, so every slot takes its left neighbour if x sorts before it,
+            // x if it is the first slot whose old element sorts after x, and stays the same
+            // otherwise. Going right to left the old neighbour is still in place.
+            for (Iter sift = cur; sift != begin; --sift) {
+                T left = *(sift - 1);
+                T here = *sift;
+                T keep = comp(x, here) ? x : here;
+                *sift = comp(x, left) ? left : keep;
+            }
+            T first = *begin;
+            *begin = comp(x, first) ? x : first;
+        }
+    }
+
+#if __cplusplus >= 201103L
+    // Insertion sort for a small range, branchless if the comparison is. Dispatching on the tag
+    // keeps branchless_insertion_sort, which copies elements, from being instantiated for types
+    // whose comparison isn't branchless, as those need not be copyable.
+    template<class Iter, class Compare>
+    inline void small_insertion_sort(Iter begin, Iter end, Compare comp, std::true_type) {
+        branchless_insertion_sort(begin, end, comp);
+    }
+
+    template<class Iter, class Compare>
+    inline void small_insertion_sort(Iter begin, Iter end, Compare comp, std::false_type) {
+        insertion_sort(begin, end, comp);
+    }
+#endif
+
     // Attempts to use insertion sort on [begin, end). Will return false if more than
     // partial_insertion_sort_limit elements were moved, and abort sorting. Otherwise it will
     // successfully sort and return true.
     template<class Iter, class Compare>
-    inline bool partial_insertion_sort(Iter begin, Iter end, Compare comp) {
+    inline PDQSORT_CONSTEXPR bool partial_insertion_sort(Iter begin, Iter end, Compare comp) {
         typedef typename std::iterator_traits<Iter>::value_type T;
         if (begin == end) return true;
         
@@ -148,13 +440,13 @@ namespace pdqsort_detail {
     }
 
     template<class Iter, class Compare>
-    inline void sort2(Iter a, Iter b, Compare comp) {
+    inline PDQSORT_CONSTEXPR void sort2(Iter a, Iter b, Compare comp) {
         if (comp(*b, *a)) std::iter_swap(a, b);
     }
 
     // Sorts the elements *a, *b and *c using comparison function comp.
     template<class Iter, class Compare>
-    inline void sort3(Iter a, Iter b, Iter c, Compare comp) {
+    inline PDQSORT_CONSTEXPR void sort3(Iter a, Iter b, Iter c, Compare comp) {
         sort2(a, b, comp);
         sort2(b, c, comp);
         sort2(a, b, comp);
@@ -171,9 +463,107 @@ namespace pdqsort_detail {
         return reinterpret_cast<T*>(ip);
     }
 
+    // Block size and offset type used by partition_right_branchless for elements of type T. The
+    // block size must be a multiple of 8 due to loop unrolling, and below 256 so offsets fit in an
+    // unsigned char. Bigger blocks amortize the swapping loop better, but for big elements the
+    // scanned memory outgrows L1.
+    template<class T>
+    struct partition_block {
+        enum { size = sizeof(T) <= 32 ? 128 : 64 };
+        typedef unsigned char offset_type;
+    };
+
+    // Software prefetch of n elements starting at it. Only done for iterators that refer to actual
+    // objects in memory, proxy iterators such as std::vector<bool>::iterator are skipped.
+#if __cplusplus >= 201103L
+    template<class Iter, bool = std::is_reference<
+        typename std::iterator_traits<Iter>::reference>::value>
+#else
+    template<class Iter, bool = false>
+#endif
+    struct prefetch_block {
+        static void ahead(Iter, size_t) { }
+    };
+
     template<class Iter>
+    struct prefetch_block<Iter, true> {
+        static void ahead(Iter it, size_t n) {
+#if defined(__GNUC__) || defined(__clang__)
+            typedef typename std::iterator_traits<Iter>::value_type T;
+            const char* p = reinterpret_cast<const char*>(&*it);
+            for (size_t i = 0; i < n * sizeof(T); i += cacheline_size) __builtin_prefetch(p + i);
+#else
+            (void) it; (void) n;
+#endif
+        }
+    };
+
+    // Moves value down from the hole at index hole of the heap [begin, begin + size), bottom-up as
+    // in Wegener's heapsort: the hole first follows the larger children all the way down to a leaf,
+    // picking the child without a branch, and value is then sifted up from there. Most values
+    // belong near the bottom, so this takes about half the comparisons of a regular sift-down, and
+    // the descent has no unpredictable branches.
+    template<class Iter, class Compare>
+    inline PDQSORT_CONSTEXPR void sift_down(
+            Iter begin, typename std::iterator_traits<Iter>::difference_type hole,
+            typename std::iterator_traits<Iter>::difference_type size,
+            typename std::iterator_traits<Iter>::value_type& value, Compare comp) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+        typedef typename std::iterator_traits<Iter>::difference_type diff_t;
+        const size_t heap_prefetch_count = sizeof(T) <= 16 ? 16 : 4 * cacheline_size / sizeof(T);
+        diff_t top = hole;
+        diff_t child = 2 * hole + 1;
+        while (child + 1 < size) {
+            // Each step depends on the previous comparison, so in big heaps the descent would wait
+            // on memory at every level. Request the descendants four levels down in advance.
+            diff_t descendants = 16 * hole + 15;
+            if (!PDQSORT_IS_CONSTANT_EVALUATED() && descendants < size) {
+                prefetch_block<Iter>::ahead(begin + descendants, heap_prefetch_count);
+            }
+
+            child += comp(begin[child], begin[child + 1]);
+            begin[hole] = PDQSORT_PREFER_MOVE(begin[child]);
+            hole = child;
+            child = 2 * hole + 1;
+        }
+
+        if (child < size) {
+            begin[hole] = PDQSORT_PREFER_MOVE(begin[child]);
+            hole = child;
+        }
+
+        while (hole > top) {
+            diff_t parent = (hole - 1) / 2;
+            if (!comp(begin[parent], value)) break;
+            begin[hole] = PDQSORT_PREFER_MOVE(begin[parent]);
+            hole = parent;
+        }
+
+        begin[hole] = PDQSORT_PREFER_MOVE(value);
+    }
+
+    // Sorts [begin, end) using bottom-up heapsort, pdqsort's O(n log n) worst case fallback.
+    template<class Iter, class Compare>
+    inline PDQSORT_CONSTEXPR void heap_sort(Iter begin, Iter end, Compare comp) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+        typedef typename std::iterator_traits<Iter>::difference_type diff_t;
+        diff_t size = end - begin;
+
+        for (diff_t i = size / 2; i-- > 0;) {
+            T value = PDQSORT_PREFER_MOVE(begin[i]);
+            sift_down(begin, i, size, value, comp);
+        }
+
+        for (diff_t i = size - 1; i > 0; --i) {
+            T value = PDQSORT_PREFER_MOVE(begin[i]);
+            begin[i] = PDQSORT_PREFER_MOVE(begin[0]);
+            sift_down(begin, diff_t(0), i, value, comp);
+        }
+    }
+
+    template<class Iter, class Offset>
     inline void swap_offsets(Iter first, Iter last,
-                             unsigned char* offsets_l, unsigned char* offsets_r,
+                             Offset* offsets_l, Offset* offsets_r,
                              size_t num, bool use_swaps) {
         typedef typename std::iterator_traits<Iter>::value_type T;
         if (use_swaps) {
@@ -193,6 +583,179 @@ namespace pdqsort_detail {
         }
     }
 
+    // State of partition_blocks between blocks: [first, last) is still to be scanned, and num_l
+    // (num_r) offsets from start_l (start_r) on, relative to offsets_l_base (offsets_r_base), are
+    // the scanned elements still on the wrong side. The offsets themselves are kept by the caller,
+    // so pdqsort_resumable can hold the state in its object and suspend the scan between blocks.
+    template<class Iter>
+    struct block_partition {
+        block_partition(Iter first, Iter last)
+            : first(first), last(last), offsets_l_base(first), offsets_r_base(last),
+              num_l(0), num_r(0), start_l(0), start_r(0) { }
+
+        Iter first;
+        Iter last;
+        Iter offsets_l_base;
+        Iter offsets_r_base;
+        size_t num_l, num_r, start_l, start_r;
+    };
+
+    // Scans and swaps blocks of state until [state.first, state.last) is empty or at least budget
+    // elements were scanned, and returns the number scanned. See partition_blocks.
+    //
+    // The following branchless partitioning is derived from "BlockQuicksort: How Branch
+    // Mispredictions don’t affect Quicksort" by Stefan Edelkamp and Armin Weiss, but heavily
+    // micro-optimized.
+    template<class Iter, class Predicate, class Offset>
+    inline size_t scan_blocks(block_partition<Iter>& state, Predicate pred,
+                              Offset* offsets_l, Offset* offsets_r, size_t budget) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+        const size_t block = partition_block<T>::size;
+
+        // Local copies, as the offset stores may alias the state as far as the compiler knows.
+        Iter first = state.first;
+        Iter last = state.last;
+        Iter offsets_l_base = state.offsets_l_base;
+        Iter offsets_r_base = state.offsets_r_base;
+        size_t num_l = state.num_l, num_r = state.num_r;
+        size_t start_l = state.start_l, start_r = state.start_r;
+        size_t scanned = 0;
+
+        while (first < last && scanned < budget) {
+            // Fill up offset blocks with elements that are on the wrong side.
+            // First we determine how much elements are considered for each offset block.
+            size_t num_unknown = last - first;
+            size_t left_split = num_l == 0 ? (num_r == 0 ? num_unknown / 2 : num_unknown) : 0;
+            size_t right_split = num_r == 0 ? (num_unknown - left_split) : 0;
+            scanned += std::min(left_split, block) + std::min(right_split, block);
+
+            // Both scan fronts move one block at a time, request the blocks after the ones we
+            // are about to scan so they are in cache by the time we get there.
+            if (num_unknown >= 4 * block) {
+                if (left_split) prefetch_block<Iter>::ahead(first + block, block);
+                if (right_split) prefetch_block<Iter>::ahead(last - 2 * block, block);
+            }
+
+            // Fill the offset blocks.
+            if (left_split >= block) {
+                for (size_t i = 0; i < block;) {
+                    offsets_l[num_l] = Offset(i++); num_l += !pred(*first); ++first;
+                    offsets_l[num_l] = Offset(i++); num_l += !pred(*first); ++first;
+                    offsets_l[num_l] = Offset(i++); num_l += !pred(*first); ++first;
+                    offsets_l[num_l] = Offset(i++); num_l += !pred(*first); ++first;
+                    offsets_l[num_l] = Offset(i++); num_l += !pred(*first); ++first;
+                    offsets_l[num_l] = Offset(i++); num_l += !pred(*first); ++first;
+                    offsets_l[num_l] = Offset(i++); num_l += !pred(*first); ++first;
+                    offsets_l[num_l] = Offset(i++); num_l += !pred(*first); ++first;
+                }
+            } else {
+                for (size_t i = 0; i < left_split;) {
+                    offsets_l[num_l] = Offset(i++); num_l += !pred(*first); ++first;
+                }
+            }
+
+            if (right_split >= block) {
+                for (size_t i = 0; i < block;) {
+                    offsets_r[num_r] = Offset(++i); num_r += pred(*--last);
+                    offsets_r[num_r] = Offset(++i); num_r += pred(*--last);
+                    offsets_r[num_r] = Offset(++i); num_r += pred(*--last);
+                    offsets_r[num_r] = Offset(++i); num_r += pred(*--last);
+                    offsets_r[num_r] = Offset(++i); num_r += pred(*--last);
+                    offsets_r[num_r] = Offset(++i); num_r += pred(*--last);
+                    offsets_r[num_r] = Offset(++i); num_r += pred(*--last);
+                    offsets_r[num_r] = Offset(++i); num_r += pred(*--last);
+                }
+            } else {
+                for (size_t i = 0; i < right_split;) {
+                    offsets_r[num_r] = Offset(++i); num_r += pred(*--last);
+                }
+            }
+
+            // Swap elements and update block sizes and first/last boundaries.
+            size_t num = std::min(num_l, num_r);
+            swap_offsets(offsets_l_base, offsets_r_base,
+                         offsets_l + start_l, offsets_r + start_r,
+                         num, num_l == num_r);
+            num_l -= num; num_r -= num;
+            start_l += num; start_r += num;
+
+            if (num_l == 0) {
+                start_l = 0;
+                offsets_l_base = first;
+            }
+            
+            if (num_r == 0) {
+                start_r = 0;
+                offsets_r_base = last;
+            }
+        }
+
+        state.first = first;
+        state.last = last;
+        state.offsets_l_base = offsets_l_base;
+        state.offsets_r_base = offsets_r_base;
+        state.num_l = num_l; state.num_r = num_r;
+        state.start_l = start_l; state.start_r = start_r;
+        return scanned;
+    }
+
+    // Swaps the elements left on the wrong side once scan_blocks has scanned all of state, and
+    // returns the partition point.
+    template<class Iter, class Offset>
+    inline Iter finish_blocks(block_partition<Iter>& state, Offset* offsets_l, Offset* offsets_r) {
+        // We have now fully identified [first, last)'s proper position. Swap the last elements.
+        Iter first = state.first;
+        Iter last = state.last;
+        size_t num_l = state.num_l, num_r = state.num_r;
+        if (num_l) {
+            offsets_l += state.start_l;
+            while (num_l--) std::iter_swap(state.offsets_l_base + offsets_l[num_l], --last);
+            first = last;
+        }
+        if (num_r) {
+            offsets_r += state.start_r;
+            while (num_r--) std::iter_swap(state.offsets_r_base - offsets_r[num_r], first), ++first;
+            last = first;
+        }
+
+        return first;
+    }
+
+    // Partitions [first, last) so the elements for which pred is true come first, and returns the
+    // partition point. The order within both sides is unspecified.
+    template<class Iter, class Predicate>
+    inline Iter partition_blocks(Iter first, Iter last, Predicate pred) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+
+        typedef typename partition_block<T>::offset_type Offset;
+        Offset offsets_l_storage[size_t(partition_block<T>::size) + cacheline_size];
+        Offset offsets_r_storage[size_t(partition_block<T>::size) + cacheline_size];
+        Offset* offsets_l = align_cacheline(offsets_l_storage);
+        Offset* offsets_r = align_cacheline(offsets_r_storage);
+
+        block_partition<Iter> state(first, last);
+        scan_blocks(state, pred, offsets_l, offsets_r, size_t(-1));
+        return finish_blocks(state, offsets_l, offsets_r);
+    }
+
+    // Whether an element belongs left of the pivot in partition_right_branchless.
+    template<class T, class Compare>
+    struct less_than_pivot {
+        less_than_pivot(const T& pivot, Compare comp) : pivot(pivot), comp(comp) { }
+        bool operator()(const T& x) { return comp(x, pivot); }
+        const T& pivot;
+        Compare comp;
+    };
+
+    // Whether an element belongs left of the pivot when equal elements are put left.
+    template<class T, class Compare>
+    struct not_greater_than {
+        not_greater_than(const T& pivot, Compare comp) : pivot(pivot), comp(comp) { }
+        bool operator()(const T& x) { return !comp(pivot, x); }
+        const T& pivot;
+        Compare comp;
+    };
+
     // Partitions [begin, end) around pivot *begin using comparison function comp. Elements equal
     // to the pivot are put in the right-hand partition. Returns the position of the pivot after
     // partitioning and whether the passed sequence already was correctly partitioned. Assumes the
@@ -223,91 +786,7 @@ namespace pdqsort_detail {
             std::iter_swap(first, last);
             ++first;
 
-            // The following branchless partitioning is derived from "BlockQuicksort: How Branch
-            // Mispredictions don’t affect Quicksort" by Stefan Edelkamp and Armin Weiss, but
-            // heavily micro-optimized.
-            unsigned char offsets_l_storage[block_size + cacheline_size];
-            unsigned char offsets_r_storage[block_size + cacheline_size];
-            unsigned char* offsets_l = align_cacheline(offsets_l_storage);
-            unsigned char* offsets_r = align_cacheline(offsets_r_storage);
-
-            Iter offsets_l_base = first;
-            Iter offsets_r_base = last;
-            size_t num_l, num_r, start_l, start_r;
-            num_l = num_r = start_l = start_r = 0;
-            
-            while (first < last) {
-                // Fill up offset blocks with elements that are on the wrong side.
-                // First we determine how much elements are considered for each offset block.
-                size_t num_unknown = last - first;
-                size_t left_split = num_l == 0 ? (num_r == 0 ? num_unknown / 2 : num_unknown) : 0;
-                size_t right_split = num_r == 0 ? (num_unknown - left_split) : 0;
-
-                // Fill the offset blocks.
-                if (left_split >= block_size) {
-                    for (size_t i = 0; i < block_size;) {
-                        offsets_l[num_l] = i++; num_l += !comp(*first, pivot); ++first;
-                        offsets_l[num_l] = i++; num_l += !comp(*first, pivot); ++first;
-                        offsets_l[num_l] = i++; num_l += !comp(*first, pivot); ++first;
-                        offsets_l[num_l] = i++; num_l += !comp(*first, pivot); ++first;
-                        offsets_l[num_l] = i++; num_l += !comp(*first, pivot); ++first;
-                        offsets_l[num_l] = i++; num_l += !comp(*first, pivot); ++first;
-                        offsets_l[num_l] = i++; num_l += !comp(*first, pivot); ++first;
-                        offsets_l[num_l] = i++; num_l += !comp(*first, pivot); ++first;
-                    }
-                } else {
-                    for (size_t i = 0; i < left_split;) {
-                        offsets_l[num_l] = i++; num_l += !comp(*first, pivot); ++first;
-                    }
-                }
-
-                if (right_split >= block_size) {
-                    for (size_t i = 0; i < block_size;) {
-                        offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
-                        offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
-                        offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
-                        offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
-                        offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
-                        offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
-                        offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
-                        offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
-                    }
-                } else {
-                    for (size_t i = 0; i < right_split;) {
-                        offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
-                    }
-                }
-
-                // Swap elements and update block sizes and first/last boundaries.
-                size_t num = std::min(num_l, num_r);
-                swap_offsets(offsets_l_base, offsets_r_base,
-                             offsets_l + start_l, offsets_r + start_r,
-                             num, num_l == num_r);
-                num_l -= num; num_r -= num;
-                start_l += num; start_r += num;
-
-                if (num_l == 0) {
-                    start_l = 0;
-                    offsets_l_base = first;
-                }
-                
-                if (num_r == 0) {
-                    start_r = 0;
-                    offsets_r_base = last;
-                }
-            }
-
-            // We have now fully identified [first, last)'s proper position. Swap the last elements.
-            if (num_l) {
-                offsets_l += start_l;
-                while (num_l--) std::iter_swap(offsets_l_base + offsets_l[num_l], --last);
-                first = last;
-            }
-            if (num_r) {
-                offsets_r += start_r;
-                while (num_r--) std::iter_swap(offsets_r_base - offsets_r[num_r], first), ++first;
-                last = first;
-            }
+            first = partition_blocks(first, last, less_than_pivot<T, Compare>(pivot, comp));
         }
 
         // Put the pivot in the right place.
@@ -326,7 +805,8 @@ namespace pdqsort_detail {
     // pivot is a median of at least 3 elements and that [begin, end) is at least
     // insertion_sort_threshold long.
     template<class Iter, class Compare>
-    inline std::pair<Iter, bool> partition_right(Iter begin, Iter end, Compare comp) {
+    inline PDQSORT_CONSTEXPR std::pair<Iter, bool> partition_right(Iter begin, Iter end,
+                                                                   Compare comp) {
         typedef typename std::iterator_traits<Iter>::value_type T;
         
         // Move pivot into local for speed.
@@ -370,7 +850,7 @@ namespace pdqsort_detail {
     // Since this is rarely used (the many equal case), and in that case pdqsort already has O(n)
     // performance, no block quicksort is applied here for simplicity.
     template<class Iter, class Compare>
-    inline Iter partition_left(Iter begin, Iter end, Compare comp) {
+    inline PDQSORT_CONSTEXPR Iter partition_left(Iter begin, Iter end, Compare comp) {
         typedef typename std::iterator_traits<Iter>::value_type T;
 
         T pivot(PDQSORT_PREFER_MOVE(*begin));
@@ -395,31 +875,272 @@ namespace pdqsort_detail {
         return pivot_pos;
     }
 
+    // Partitions [begin, end) like partition_right, but out of place: elements smaller than the
+    // pivot are compacted to the front of [begin, end) while the others are streamed into buffer,
+    // which must have room for end - begin elements, and copied back after the pivot. Every
+    // element is written to both destinations and only the write cursors depend on the
+    // comparison, so there are no branches and no dependency chain between swaps. Writing an
+    // element twice is only valid for trivially copyable types, see buffered_partition.
+    template<class Iter, class Compare>
+    inline std::pair<Iter, bool> partition_right_buffered(
+            Iter begin, Iter end, Compare comp,
+            typename std::iterator_traits<Iter>::value_type* buffer) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+
+        T pivot(PDQSORT_PREFER_MOVE(*begin));
+        Iter l = begin;
+        T* r = buffer;
+
+        // The sequence was already partitioned if no smaller element follows a bigger one.
+        bool seen_greater = false;
+        bool out_of_order = false;
+        for (Iter cur = begin + 1; cur != end; ++cur) {
+            bool smaller = comp(*cur, pivot);
+            *r = PDQSORT_PREFER_MOVE(*cur);
+            *l = PDQSORT_PREFER_MOVE(*cur);
+            l += smaller;
+            r += !smaller;
+            out_of_order |= seen_greater & smaller;
+            seen_greater |= !smaller;
+        }
+
+        Iter pivot_pos = l;
+        *pivot_pos = PDQSORT_PREFER_MOVE(pivot);
+        Iter out = pivot_pos + 1;
+        for (T* it = buffer; it != r; ++it, ++out) *out = PDQSORT_PREFER_MOVE(*it);
+
+        return std::make_pair(pivot_pos, !out_of_order);
+    }
+
+    // Calls partition_right_buffered for trivially copyable types. For other types pdqsort_loop is
+    // never given a buffer, and this isn't instantiated, so they need not be copyable at all.
+    template<bool Enabled>
+    struct buffered_partition {
+        template<class Iter, class Compare>
+        static std::pair<Iter, bool> apply(Iter begin, Iter end, Compare comp,
+                                           typename std::iterator_traits<Iter>::value_type*) {
+            return partition_right(begin, end, comp);
+        }
+    };
+
+    template<>
+    struct buffered_partition<true> {
+        template<class Iter, class Compare>
+        static std::pair<Iter, bool> apply(
+                Iter begin, Iter end, Compare comp,
+                typename std::iterator_traits<Iter>::value_type* buffer) {
+            return partition_right_buffered(begin, end, comp, buffer);
+        }
+    };
+
+#if __cplusplus >= 201103L
+    template<class T> struct can_partition_buffered : std::is_trivially_copyable<T> { };
+#else
+    template<class T> struct can_partition_buffered { enum { value = false }; };
+#endif
+
+    // Chooses the pivot as median of 3 or pseudomedian of 9 and puts it at *begin.
+    template<class Iter, class Compare>
+    inline PDQSORT_CONSTEXPR void choose_pivot(Iter begin, Iter end, Compare comp) {
+        typedef typename std::iterator_traits<Iter>::difference_type diff_t;
+        diff_t size = end - begin;
+        diff_t s2 = size / 2;
+        if (size > ninther_threshold) {
+            sort3(begin, begin + s2, end - 1, comp);
+            sort3(begin + 1, begin + (s2 - 1), end - 2, comp);
+            sort3(begin + 2, begin + (s2 + 1), end - 3, comp);
+            sort3(begin + (s2 - 1), begin + s2, begin + (s2 + 1), comp);
+            std::iter_swap(begin, begin + s2);
+        } else sort3(begin + s2, begin, end - 1, comp);
+    }
+
+    // Returns whether [begin, end) is sorted, stopping at the first descent.
+    template<class Iter, class Compare>
+    inline bool is_sorted(Iter begin, Iter end, Compare comp) {
+        if (begin == end) return true;
+        for (Iter cur = begin + 1; cur != end; ++cur) {
+            if (comp(*cur, *(cur - 1))) return false;
+        }
+        return true;
+    }
+
+    // Returns whichever of a, b and c points to the median, without moving any elements.
+    template<class Iter, class Compare>
+    inline Iter median3(Iter a, Iter b, Iter c, Compare comp) {
+        if (comp(*b, *a)) std::swap(a, b);
+        if (comp(*c, *b)) b = comp(*c, *a) ? a : c;
+        return b;
+    }
+
+    // Picks the pivot of [begin, end) like choose_pivot, but only reads the elements.
+    template<class Iter, class Compare>
+    inline Iter choose_pivot_copy(Iter begin, Iter end, Compare comp) {
+        typedef typename std::iterator_traits<Iter>::difference_type diff_t;
+        diff_t size = end - begin;
+        diff_t s2 = size / 2;
+        if (size > ninther_threshold) {
+            return median3(median3(begin, begin + s2, end - 1, comp),
+                           median3(begin + 1, begin + (s2 - 1), end - 2, comp),
+                           median3(begin + 2, begin + (s2 + 1), end - 3, comp), comp);
+        }
+        return median3(begin + s2, begin, end - 1, comp);
+    }
+
+    // Copies [first, last) to [out, out + (last - first)) partitioned around *pivot_it, which is
+    // chosen in the source, so the source is only read. Smaller elements are written to the front
+    // of the output, the others to the back in reverse order, and the pivot in between, so every
+    // element is written exactly once. If the source was already partitioned the back is reversed
+    // again, so sorted runs stay sorted. Returns the position of the pivot in the output.
+    template<class InIter, class OutIter, class Compare>
+    inline OutIter partition_copy_right(InIter first, InIter last, InIter pivot_it, OutIter out,
+                                        Compare comp) {
+        typedef typename std::iterator_traits<InIter>::value_type T;
+        typedef typename std::iterator_traits<OutIter>::difference_type diff_t;
+
+        T pivot(*pivot_it);
+        diff_t size = last - first;
+        diff_t l = 0;
+        diff_t r = size - 1;
+
+        bool seen_greater = false;
+        bool out_of_order = false;
+        for (InIter cur = first; cur != last; ++cur) {
+            if (cur == pivot_it) continue;
+
+            bool smaller = comp(*cur, pivot);
+            if (smaller) out[l++] = *cur;
+            else         out[r--] = *cur;
+            out_of_order |= seen_greater & smaller;
+            seen_greater |= !smaller;
+        }
+
+        out[l] = PDQSORT_PREFER_MOVE(pivot);
+        if (!out_of_order) std::reverse(out + (l + 1), out + size);
+        return out + l;
+    }
+
+    // Returns the first element in the sorted range [begin, end) that is greater than value, like
+    // std::upper_bound, but searching exponentially backwards from end first, so that it takes
+    // O(log d) comparisons if the result is d elements before end.
+    template<class Iter, class T, class Compare>
+    inline Iter gallop_upper_bound_back(Iter begin, Iter end, const T& value, Compare comp) {
+        typedef typename std::iterator_traits<Iter>::difference_type diff_t;
+        diff_t size = end - begin;
+        diff_t greater = 0;
+        diff_t step = 1;
+        while (step <= size && comp(value, *(end - step))) {
+            greater = step;
+            step *= 2;
+        }
+
+        return std::upper_bound(step <= size ? end - step : begin, end - greater, value, comp);
+    }
+
+    // Merges the sorted range [buffer, buffer + size) into the sorted range [first, last), whose
+    // end must be followed by size elements of free space, from the back. Every buffered element
+    // gallops backwards over the elements of [first, last) that are greater than it, which are
+    // then moved as a block, so merging a few elements into a long range takes few comparisons and
+    // the moves become a memmove for trivially copyable types.
+    // Elements of [first, last) go before equal buffered elements.
+    template<class Iter, class T, class Compare>
+    inline void merge_tail(Iter first, Iter last, T* buffer, std::size_t size, Compare comp) {
+        Iter out = last + size;
+        while (size > 0) {
+            T& value = buffer[size - 1];
+            Iter greater = gallop_upper_bound_back(first, last, value, comp);
+#if __cplusplus >= 201103L
+            out = std::move_backward(greater, last, out);
+#else
+            out = std::copy_backward(greater, last, out);
+#endif
+            last = greater;
+            *--out = PDQSORT_PREFER_MOVE(value);
+            --size;
+
+            if (last == first) break;
+        }
+
+        while (size > 0) *--out = PDQSORT_PREFER_MOVE(buffer[--size]);
+    }
+
+    // Swaps a few elements on both sides of a highly unbalanced partition around pivot_pos, to
+    // break the patterns that made it unbalanced.
+    template<class Iter>
+    inline PDQSORT_CONSTEXPR void break_patterns(Iter begin, Iter pivot_pos, Iter end) {
+        typedef typename std::iterator_traits<Iter>::difference_type diff_t;
+        diff_t l_size = pivot_pos - begin;
+        diff_t r_size = end - (pivot_pos + 1);
+
+        if (l_size >= insertion_sort_threshold) {
+            std::iter_swap(begin,             begin + l_size / 4);
+            std::iter_swap(pivot_pos - 1, pivot_pos - l_size / 4);
+
+            if (l_size > ninther_threshold) {
+                std::iter_swap(begin + 1,         begin + (l_size / 4 + 1));
+                std::iter_swap(begin + 2,         begin + (l_size / 4 + 2));
+                std::iter_swap(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));
+                std::iter_swap(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));
+            }
+        }
+        
+        if (r_size >= insertion_sort_threshold) {
+            std::iter_swap(pivot_pos + 1, pivot_pos + (1 + r_size / 4));
+            std::iter_swap(end - 1,                   end - r_size / 4);
+            
+            if (r_size > ninther_threshold) {
+                std::iter_swap(pivot_pos + 2, pivot_pos + (2 + r_size / 4));
+                std::iter_swap(pivot_pos + 3, pivot_pos + (3 + r_size / 4));
+                std::iter_swap(end - 2,             end - (1 + r_size / 4));
+                std::iter_swap(end - 3,             end - (2 + r_size / 4));
+            }
+        }
+    }
+
+    // A range that pdqsort_loop still has to sort, with the state it needs to sort it.
+    template<class Iter>
+    struct pending_range {
+        Iter begin;
+        Iter end;
+        int bad_allowed;
+        bool leftmost;
+    };
 
+    // Sorts [begin, end). If a scratch buffer is given, partitions that fit in it are partitioned
+    // out of place with partition_right_buffered, bigger ones in place.
+    //
+    // Instead of recursing, the larger side of every partition is pushed on a fixed size stack and
+    // the smaller side is sorted first. The smaller side is at most half the size, so at most
+    // log2(end - begin) ranges are ever pending and the stack can't overflow. Stack use is bounded
+    // by this single frame, which matters when sorting on small stacks such as those of fibers.
     template<class Iter, class Compare, bool Branchless>
-    inline void pdqsort_loop(Iter begin, Iter end, Compare comp, int bad_allowed, bool leftmost = true) {
+    inline PDQSORT_CONSTEXPR void pdqsort_loop(
+            Iter begin, Iter end, Compare comp, int bad_allowed, bool leftmost = true,
+            typename std::iterator_traits<Iter>::value_type* buffer = 0,
+            std::size_t buffer_size = 0) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
         typedef typename std::iterator_traits<Iter>::difference_type diff_t;
+        pending_range<Iter> stack[sizeof(std::size_t) * 8];
+        std::size_t stack_size = 0;
 
-        // Use a while loop for tail recursion elimination.
         while (true) {
             diff_t size = end - begin;
 
-            // Insertion sort is faster for small arrays.
+            // Insertion sort is faster for small arrays. This also finishes ranges that are
+            // already sorted, which are emptied, after which we continue with a pending range.
             if (size < insertion_sort_threshold) {
                 if (leftmost) insertion_sort(begin, end, comp);
                 else unguarded_insertion_sort(begin, end, comp);
-                return;
+
+                if (stack_size == 0) return;
+                --stack_size;
+                begin = stack[stack_size].begin;
+                end = stack[stack_size].end;
+                bad_allowed = stack[stack_size].bad_allowed;
+                leftmost = stack[stack_size].leftmost;
+                continue;
             }
 
-            // Choose pivot as median of 3 or pseudomedian of 9.
-            diff_t s2 = size / 2;
-            if (size > ninther_threshold) {
-                sort3(begin, begin + s2, end - 1, comp);
-                sort3(begin + 1, begin + (s2 - 1), end - 2, comp);
-                sort3(begin + 2, begin + (s2 + 1), end - 3, comp);
-                sort3(begin + (s2 - 1), begin + s2, begin + (s2 + 1), comp);
-                std::iter_swap(begin, begin + s2);
-            } else sort3(begin + s2, begin, end - 1, comp);
+            choose_pivot(begin, end, comp);
 
             // If *(begin - 1) is the end of the right partition of a previous partition operation
             // there is no element in [begin, end) that is smaller than *(begin - 1). Then if our
@@ -433,8 +1154,12 @@ namespace pdqsort_detail {
 
             // Partition and get results.
             std::pair<Iter, bool> part_result =
-                Branchless ? partition_right_branchless(begin, end, comp)
-                           : partition_right(begin, end, comp);
+                std::size_t(size) <= buffer_size
+                    ? buffered_partition<can_partition_buffered<T>::value>::apply(begin, end, comp,
+                                                                                buffer)
+                    : Branchless && !PDQSORT_IS_CONSTANT_EVALUATED()
+                        ? partition_right_branchless(begin, end, comp)
+                        : partition_right(begin, end, comp);
             Iter pivot_pos = part_result.first;
             bool already_partitioned = part_result.second;
 
@@ -447,84 +1172,2699 @@ namespace pdqsort_detail {
             if (highly_unbalanced) {
                 // If we had too many bad partitions, switch to heapsort to guarantee O(n log n).
                 if (--bad_allowed == 0) {
-                    std::make_heap(begin, end, comp);
-                    std::sort_heap(begin, end, comp);
-                    return;
+                    heap_sort(begin, end, comp);
+                    begin = end;
+                    continue;
                 }
 
-                if (l_size >= insertion_sort_threshold) {
-                    std::iter_swap(begin,             begin + l_size / 4);
-                    std::iter_swap(pivot_pos - 1, pivot_pos - l_size / 4);
-
-                    if (l_size > ninther_threshold) {
-                        std::iter_swap(begin + 1,         begin + (l_size / 4 + 1));
-                        std::iter_swap(begin + 2,         begin + (l_size / 4 + 2));
-                        std::iter_swap(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));
-                        std::iter_swap(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));
-                    }
-                }
-                
-                if (r_size >= insertion_sort_threshold) {
-                    std::iter_swap(pivot_pos + 1, pivot_pos + (1 + r_size / 4));
-                    std::iter_swap(end - 1,                   end - r_size / 4);
-                    
-                    if (r_size > ninther_threshold) {
-                        std::iter_swap(pivot_pos + 2, pivot_pos + (2 + r_size / 4));
-                        std::iter_swap(pivot_pos + 3, pivot_pos + (3 + r_size / 4));
-                        std::iter_swap(end - 2,             end - (1 + r_size / 4));
-                        std::iter_swap(end - 3,             end - (2 + r_size / 4));
-                    }
-                }
+                break_patterns(begin, pivot_pos, end);
             } else {
                 // If we were decently balanced and we tried to sort an already partitioned
                 // sequence try to use insertion sort.
                 if (already_partitioned && partial_insertion_sort(begin, pivot_pos, comp)
-                                        && partial_insertion_sort(pivot_pos + 1, end, comp)) return;
+                                        && partial_insertion_sort(pivot_pos + 1, end, comp)) {
+                    begin = end;
+                    continue;
+                }
+            }
+
+            // Push the larger partition and continue with the smaller one.
+            pending_range<Iter>& pending = stack[stack_size++];
+            pending.bad_allowed = bad_allowed;
+            if (l_size > r_size) {
+                pending.begin = begin;
+                pending.end = pivot_pos;
+                pending.leftmost = leftmost;
+                begin = pivot_pos + 1;
+                leftmost = false;
+            } else {
+                pending.begin = pivot_pos + 1;
+                pending.end = end;
+                pending.leftmost = false;
+                end = pivot_pos;
             }
-                
-            // Sort the left partition first using recursion and do tail recursion elimination for
-            // the right-hand partition.
-            pdqsort_loop<Iter, Compare, Branchless>(begin, pivot_pos, comp, bad_allowed, leftmost);
-            begin = pivot_pos + 1;
-            leftmost = false;
         }
     }
-}
 
+    // Compares two indices into base by the elements they refer to.
+    template<class Iter, class Compare>
+    struct indirect_compare {
+        indirect_compare(Iter base, Compare comp) : base(base), comp(comp) { }
 
-template<class Iter, class Compare>
-inline void pdqsort(Iter begin, Iter end, Compare comp) {
-    if (begin == end) return;
+        bool operator()(std::size_t a, std::size_t b) {
+            return comp(base[a], base[b]);
+        }
 
-#if __cplusplus >= 201103L
-    pdqsort_detail::pdqsort_loop<Iter, Compare,
-        pdqsort_detail::is_default_compare<typename std::decay<Compare>::type>::value &&
-        std::is_arithmetic<typename std::iterator_traits<Iter>::value_type>::value>(
-        begin, end, comp, pdqsort_detail::log2(end - begin));
-#else
-    pdqsort_detail::pdqsort_loop<Iter, Compare, false>(
+        Iter base;
+        Compare comp;
+    };
+
+    // Compares two (key, index) pairs by key only.
+    template<class Key, class Compare>
+    struct key_index_compare {
+        key_index_compare(Compare comp) : comp(comp) { }
+
+        bool operator()(const std::pair<Key, std::size_t>& a,
+                        const std::pair<Key, std::size_t>& b) {
+            return comp(a.first, b.first);
+        }
+
+        Compare comp;
+    };
+
+    inline std::size_t& index_of(std::size_t& i) { return i; }
+
+    template<class Key>
+    inline std::size_t& index_of(std::pair<Key, std::size_t>& p) { return p.second; }
+
+    // Owns an array allocated without throwing, data is null if the allocation failed. In C++11 the
+    // array is taken from the scratch memory of context instead if one is given and T is trivially
+    // destructible.
+    template<class T>
+    struct nothrow_buffer {
+#if __cplusplus >= 201103L
+        nothrow_buffer(std::size_t size, pdqsort_context* context = 0)
+            : context(std::is_trivially_destructible<T>::value ? context : 0),
+              bytes(size * sizeof(T)), data(0) {
+            if (!this->context) {
+                data = new (std::nothrow) T[size];
+                return;
+            }
+
+            data = static_cast<T*>(this->context->acquire(bytes));
+            if (data) for (std::size_t i = 0; i < size; ++i) new (data + i) T;
+        }
+
+        ~nothrow_buffer() {
+            if (context) context->release(data, bytes);
+            else delete[] data;
+        }
+
+        pdqsort_context* context;
+        std::size_t bytes;
+#else
+        nothrow_buffer(std::size_t size, pdqsort_context* = 0)
+            : data(new (std::nothrow) T[size]) { }
+        ~nothrow_buffer() { delete[] data; }
+#endif
+        T* data;
+
+    private:
+        nothrow_buffer(const nothrow_buffer&);
+        nothrow_buffer& operator=(const nothrow_buffer&);
+    };
+
+    // Owns uninitialized storage for size elements of T allocated without throwing, data is null if
+    // the allocation failed. Unlike nothrow_buffer T needn't be default constructible: elements are
+    // move constructed at the end with push_back, and those are destroyed with the buffer.
+    template<class T>
+    struct raw_buffer {
+        raw_buffer(std::size_t size)
+            : data(static_cast<T*>(::operator new(size * sizeof(T), std::nothrow))), size(0) { }
+
+        ~raw_buffer() {
+            while (size > 0) data[--size].~T();
+            ::operator delete(data);
+        }
+
+        void push_back(T& value) {
+            new (data + size) T(PDQSORT_PREFER_MOVE(value));
+            ++size;
+        }
+
+        T* data;
+        std::size_t size;
+
+    private:
+        raw_buffer(const raw_buffer&);
+        raw_buffer& operator=(const raw_buffer&);
+    };
+
+    // Applies a permutation to [begin, begin + size) in place, where position i receives the
+    // element at index_of(perm[i]). Walks every cycle once, so each element is moved exactly once
+    // (plus a move in and out of a temporary per cycle). Destroys perm.
+    template<class Iter, class PermIter>
+    inline void apply_permutation(Iter begin, std::size_t size, PermIter perm) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+
+        for (std::size_t i = 0; i < size; ++i) {
+            if (index_of(perm[i]) == i) continue;
+
+            // Positions that are done are marked by making them fixed points.
+            T tmp = PDQSORT_PREFER_MOVE(begin[i]);
+            std::size_t cur = i;
+            while (index_of(perm[cur]) != i) {
+                std::size_t next = index_of(perm[cur]);
+                begin[cur] = PDQSORT_PREFER_MOVE(begin[next]);
+                index_of(perm[cur]) = cur;
+                cur = next;
+            }
+            begin[cur] = PDQSORT_PREFER_MOVE(tmp);
+            index_of(perm[cur]) = cur;
+        }
+    }
+
+    // Sorts [begin, end) by sorting an array of indices into it and then applying the resulting
+    // permutation. Comparisons go through the indices, so this only wins when moving elements is
+    // far more expensive than the scattered reads. Returns false without touching [begin, end) if
+    // the index array could not be allocated.
+    template<class Iter, class Compare>
+    inline bool sort_indirect(Iter begin, Iter end, Compare comp, pdqsort_context* context = 0) {
+        std::size_t size = end - begin;
+        nothrow_buffer<std::size_t> idx(size, context);
+        if (!idx.data) return false;
+
+        for (std::size_t i = 0; i < size; ++i) idx.data[i] = i;
+        pdqsort_loop<std::size_t*, indirect_compare<Iter, Compare>, false>(
+            idx.data, idx.data + size, indirect_compare<Iter, Compare>(begin, comp), log2(size));
+        apply_permutation(begin, size, idx.data);
+        return true;
+    }
+
+#if __cplusplus >= 201103L
+    template<class KeyFn, class T>
+    struct key_type {
+        typedef typename std::decay<
+            decltype(std::declval<KeyFn&>()(std::declval<const T&>()))>::type type;
+    };
+
+    // Compares two elements by the keys extracted from them.
+    template<class KeyFn, class Compare>
+    struct projected_compare {
+        projected_compare(KeyFn key, Compare comp) : key(key), comp(comp) { }
+
+        template<class T>
+        bool operator()(const T& a, const T& b) {
+            return comp(key(a), key(b));
+        }
+
+        KeyFn key;
+        Compare comp;
+    };
+
+    // Like sort_indirect, but sorts compact (key(element), index) pairs, so comparisons never
+    // touch the elements themselves. Key must be default constructible.
+    template<bool Branchless, class Iter, class KeyFn, class Compare>
+    inline bool sort_indirect_by_key(Iter begin, Iter end, KeyFn key, Compare comp,
+                                     pdqsort_context* context = 0) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+        typedef typename key_type<KeyFn, T>::type Key;
+        typedef std::pair<Key, std::size_t> Pair;
+
+        std::size_t size = end - begin;
+        nothrow_buffer<Pair> pairs(size, context);
+        if (!pairs.data) return false;
+
+        for (std::size_t i = 0; i < size; ++i) {
+            pairs.data[i].first = key(begin[i]);
+            pairs.data[i].second = i;
+        }
+        pdqsort_loop<Pair*, key_index_compare<Key, Compare>, Branchless>(
+            pairs.data, pairs.data + size, key_index_compare<Key, Compare>(comp), log2(size));
+        apply_permutation(begin, size, pairs.data);
+        return true;
+    }
+
+    typedef std::pair<std::uint64_t, std::size_t> record_prefix;
+
+    // Reads the first 8 bytes of a key of key_size bytes as a big-endian integer, so integer order
+    // is memcmp order. Shorter keys are padded with zeroes.
+    inline std::uint64_t load_key_prefix(const unsigned char* key, std::size_t key_size) {
+        unsigned char bytes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        std::memcpy(bytes, key, key_size < 8 ? key_size : 8);
+        std::uint64_t prefix = 0;
+        for (int i = 0; i < 8; ++i) prefix = (prefix << 8) | bytes[i];
+        return prefix;
+    }
+
+    // Compares two records by their key prefixes only.
+    struct record_prefix_compare {
+        bool operator()(const record_prefix& a, const record_prefix& b) const {
+            return a.first < b.first;
+        }
+    };
+
+    // Compares two records with equal key prefixes by memcmp on the rest of their keys, and by
+    // index if those are equal too.
+    struct record_suffix_compare {
+        record_suffix_compare(const unsigned char* data, std::size_t record_size,
+                              std::size_t offset, std::size_t size)
+            : data(data), record_size(record_size), offset(offset), size(size) { }
+
+        bool operator()(const record_prefix& a, const record_prefix& b) const {
+            int c = std::memcmp(data + a.second * record_size + offset,
+                                data + b.second * record_size + offset, size);
+            return c < 0 || (c == 0 && a.second < b.second);
+        }
+
+        const unsigned char* data;
+        std::size_t record_size;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    // Copies the records of data to out in the order given by perm.
+    inline void gather_records(const unsigned char* data, std::size_t record_size,
+                               std::size_t size, const record_prefix* perm, unsigned char* out) {
+        const std::size_t distance = 8;
+        for (std::size_t i = 0; i < size; ++i) {
+            if (i + distance < size) {
+                prefetch_block<const unsigned char*>::ahead(
+                    data + perm[i + distance].second * record_size, record_size);
+            }
+            std::memcpy(out + i * record_size, data + perm[i].second * record_size, record_size);
+        }
+    }
+
+    // Like apply_permutation, for records of record_size bytes without a type. tmp must have room
+    // for one record. Destroys perm.
+    inline void apply_record_permutation(unsigned char* data, std::size_t record_size,
+                                         std::size_t size, record_prefix* perm,
+                                         unsigned char* tmp) {
+        for (std::size_t i = 0; i < size; ++i) {
+            if (perm[i].second == i) continue;
+
+            std::memcpy(tmp, data + i * record_size, record_size);
+            std::size_t cur = i;
+            while (perm[cur].second != i) {
+                std::size_t next = perm[cur].second;
+                std::memcpy(data + cur * record_size, data + next * record_size, record_size);
+                perm[cur].second = cur;
+                cur = next;
+            }
+            std::memcpy(data + cur * record_size, tmp, record_size);
+            perm[cur].second = cur;
+        }
+    }
+
+    // Implements pdqsort_records.
+    inline void sort_records(void* data, std::size_t num_records, std::size_t record_size,
+                             std::size_t key_offset, std::size_t key_size,
+                             pdqsort_context* context) {
+        typedef record_prefix Pair;
+
+        unsigned char* bytes = static_cast<unsigned char*>(data);
+        nothrow_buffer<Pair> pairs(num_records, context);
+        if (!pairs.data) throw std::bad_alloc();
+
+        for (std::size_t i = 0; i < num_records; ++i) {
+            pairs.data[i].first = load_key_prefix(bytes + i * record_size + key_offset, key_size);
+            pairs.data[i].second = i;
+        }
+
+        // Comparing the prefixes alone keeps the comparison branchless. Runs of equal prefixes are
+        // then sorted by the rest of the key and by index, which makes the sort stable.
+        typedef record_prefix_compare PrefixCompare;
+        typedef record_suffix_compare SuffixCompare;
+        pdqsort_loop<Pair*, PrefixCompare, true>(pairs.data, pairs.data + num_records,
+                                                 PrefixCompare(), log2(num_records));
+
+        std::size_t suffix_size = key_size > 8 ? key_size - 8 : 0;
+        SuffixCompare suffix_comp(bytes, record_size, key_offset + key_size - suffix_size,
+                                  suffix_size);
+        for (Pair* run = pairs.data; run != pairs.data + num_records; ) {
+            Pair* run_end = run + 1;
+            while (run_end != pairs.data + num_records && run_end->first == run->first) ++run_end;
+            if (run_end - run > 1) {
+                pdqsort_loop<Pair*, SuffixCompare, false>(run, run_end, suffix_comp,
+                                                          log2(run_end - run));
+            }
+            run = run_end;
+        }
+
+        // Gathering the records into a copy reads them independently of each other, so many reads
+        // can be in flight at once, while following the cycles of the permutation waits for every
+        // read. That outweighs copying every record twice: for a million records the gather is
+        // about 25% faster, and for 10^4 records the two are within noise.
+        nothrow_buffer<unsigned char> out(num_records * record_size, context);
+        if (out.data) {
+            gather_records(bytes, record_size, num_records, pairs.data, out.data);
+            std::memcpy(bytes, out.data, num_records * record_size);
+            return;
+        }
+
+        nothrow_buffer<unsigned char> tmp(record_size, context);
+        if (!tmp.data) throw std::bad_alloc();
+        apply_record_permutation(bytes, record_size, num_records, pairs.data, tmp.data);
+    }
+
+    inline void count_sort(pdqsort_context& context, std::size_t size) {
+        ++context.counters.sorts;
+        context.counters.elements += size;
+    }
+#endif
+
+#if __cplusplus >= 201103L
+    template<class F> struct float_bits { };
+    template<> struct float_bits<float> { typedef std::uint32_t type; };
+    template<> struct float_bits<double> { typedef std::uint64_t type; };
+
+    // Maps floating point numbers to unsigned integers with the same order and back: positive
+    // numbers get their sign bit set, negative numbers get all bits flipped. The integer order is
+    // IEEE 754 totalOrder (-NaN < -inf < ... < -0 < +0 < ... < +inf < +NaN).
+    template<class F>
+    struct float_key {
+        typedef typename float_bits<F>::type U;
+        static const int bits = sizeof(U) * 8;
+
+        static U to_key(F f) {
+            U u; std::memcpy(&u, &f, sizeof(u));
+            return u ^ ((U(0) - (u >> (bits - 1))) | (U(1) << (bits - 1)));
+        }
+
+        static F from_key(U u) {
+            u ^= (U(0) - ((~u) >> (bits - 1))) | (U(1) << (bits - 1));
+            F f; std::memcpy(&f, &u, sizeof(f));
+            return f;
+        }
+    };
+
+    template<class F>
+    struct float_total_order_compare {
+        bool operator()(F a, F b) const {
+            return float_key<F>::to_key(a) < float_key<F>::to_key(b);
+        }
+    };
+
+    template<class F>
+    struct is_nan {
+        bool operator()(F f) const { return f != f; }
+    };
+
+    template<class F>
+    struct is_not_nan {
+        bool operator()(F f) const { return f == f; }
+    };
+
+    // Sorts [begin, end) by IEEE 754 totalOrder. The keys are mapped to unsigned integers in a
+    // scratch buffer, so the branchless integer path sorts them, and are mapped back afterwards.
+    // If the buffer can't be allocated the keys are mapped on every comparison instead.
+    template<class Iter>
+    inline void sort_float_total_order(Iter begin, Iter end) {
+        typedef typename std::iterator_traits<Iter>::value_type F;
+        typedef typename float_key<F>::U U;
+
+        std::size_t size = end - begin;
+        nothrow_buffer<U> keys(size);
+        if (!keys.data) {
+            pdqsort_loop<Iter, float_total_order_compare<F>, true>(
+                begin, end, float_total_order_compare<F>(), log2(size));
+            return;
+        }
+
+        for (std::size_t i = 0; i < size; ++i) keys.data[i] = float_key<F>::to_key(begin[i]);
+        pdqsort_loop<U*, std::less<U>, true>(
+            keys.data, keys.data + size, std::less<U>(), log2(size));
+        for (std::size_t i = 0; i < size; ++i) begin[i] = float_key<F>::from_key(keys.data[i]);
+    }
+
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 uint128;
+    template<> struct is_branchless_key<uint128> : std::true_type { };
+#endif
+
+    // Maps a key field to an unsigned integer of the same width with the same order. Signed
+    // integers get their sign bit flipped, floating point numbers are ordered by totalOrder and
+    // descending fields are inverted.
+    template<class T, class Enable = void>
+    struct normalized_field { };
+
+    template<class T>
+    struct normalized_field<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+        typedef typename std::make_unsigned<T>::type U;
+        static U get(T v) {
+            return std::is_signed<T>::value ? U(U(v) ^ (U(1) << (sizeof(U) * 8 - 1))) : U(v);
+        }
+        static T put(U u) {
+            return T(std::is_signed<T>::value ? U(u ^ (U(1) << (sizeof(U) * 8 - 1))) : u);
+        }
+    };
+
+    template<>
+    struct normalized_field<bool> {
+        typedef unsigned char U;
+        static U get(bool v) { return v; }
+        static bool put(U u) { return u != 0; }
+    };
+
+    template<class T>
+    struct normalized_field<T, typename std::enable_if<std::is_enum<T>::value>::type> {
+        typedef typename std::underlying_type<T>::type Underlying;
+        typedef typename normalized_field<Underlying>::U U;
+        static U get(T v) { return normalized_field<Underlying>::get(Underlying(v)); }
+        static T put(U u) { return T(normalized_field<Underlying>::put(u)); }
+    };
+
+    template<class T>
+    struct normalized_field<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+        typedef typename float_key<T>::U U;
+        static U get(T v) { return float_key<T>::to_key(v); }
+    };
+
+    template<class T>
+    struct normalized_field<pdqsort_descending_key<T> > {
+        typedef typename normalized_field<T>::U U;
+        static U get(pdqsort_descending_key<T> v) { return U(~normalized_field<T>::get(v.value)); }
+    };
+
+    // Total width in bits of the normalized fields of a tuple.
+    template<class Tuple> struct packed_width;
+    template<> struct packed_width<std::tuple<> > : std::integral_constant<int, 0> { };
+    template<class T, class... Ts> struct packed_width<std::tuple<T, Ts...> >
+        : std::integral_constant<int, int(sizeof(typename normalized_field<T>::U) * 8) +
+                                      packed_width<std::tuple<Ts...> >::value> { };
+
+    // The smallest unsigned integer that fits all fields of a tuple.
+    template<class Tuple, int Width = packed_width<Tuple>::value>
+    struct packed_type {
+#ifdef __SIZEOF_INT128__
+        static_assert(Width <= 128, "pdqsort_packed keys can be at most 128 bits wide");
+        typedef typename std::conditional<Width <= 32, std::uint32_t,
+                typename std::conditional<Width <= 64, std::uint64_t, uint128>::type>::type type;
+#else
+        static_assert(Width <= 64, "pdqsort_packed keys can be at most 64 bits wide");
+        typedef typename std::conditional<Width <= 32, std::uint32_t, std::uint64_t>::type type;
+#endif
+    };
+
+    // Packs fields I... of a tuple after acc, most significant field first.
+    template<std::size_t I, class U, class Tuple>
+    inline typename std::enable_if<I == std::tuple_size<Tuple>::value, U>::type
+    pack_fields(U acc, const Tuple&) {
+        return acc;
+    }
+
+    template<std::size_t I, class U, class Tuple>
+    inline typename std::enable_if<I < std::tuple_size<Tuple>::value, U>::type
+    pack_fields(U acc, const Tuple& t) {
+        typedef typename std::tuple_element<I, Tuple>::type Field;
+        typedef normalized_field<Field> Normalized;
+        const int width = sizeof(typename Normalized::U) * 8;
+        return pack_fields<I + 1>(U(acc << width) | U(Normalized::get(std::get<I>(t))), t);
+    }
+
+    // Wraps a function returning a tuple of key fields into one returning a single packed key.
+    template<class KeyFn, class T>
+    struct packed_key_fn {
+        typedef typename key_type<KeyFn, T>::type Tuple;
+        typedef typename packed_type<Tuple>::type type;
+
+        packed_key_fn(KeyFn key) : key(key) { }
+
+        type operator()(const T& v) {
+            Tuple t = key(v);
+            return pack_fields<1>(type(normalized_field<
+                typename std::tuple_element<0, Tuple>::type>::get(std::get<0>(t))), t);
+        }
+
+        KeyFn key;
+    };
+#endif
+
+    // Merges duplicates for pdqsort_unique by keeping the first of them.
+    template<class T>
+    struct keep_first {
+        void operator()(T&, T&) const { }
+    };
+
+    // Merges duplicates for pdqsort_reduce by combining them into the first of them.
+    template<class T, class Combine>
+    struct combine_into {
+        combine_into(Combine combine) : combine(combine) { }
+        void operator()(T& acc, T& x) {
+            acc = combine(PDQSORT_PREFER_MOVE(acc), PDQSORT_PREFER_MOVE(x));
+        }
+        Combine combine;
+    };
+
+    // Appends the sorted range [begin, end) to the sorted output [first, out) which has no
+    // equivalent elements, and returns the new end of the output. Elements equivalent to the last
+    // output element are merged into it with reduce. out must not come after begin.
+    template<class Iter, class Compare, class Reduce>
+    inline Iter reduce_sorted(Iter first, Iter out, Iter begin, Iter end, Compare comp,
+                              Reduce& reduce) {
+        for (; begin != end; ++begin) {
+            if (out != first && !comp(*(out - 1), *begin)) reduce(*(out - 1), *begin);
+            else {
+                if (out != begin) *out = PDQSORT_PREFER_MOVE(*begin);
+                ++out;
+            }
+        }
+
+        return out;
+    }
+
+    // Like pdqsort_loop, but writes the sorted elements of [begin, end) with equivalent elements
+    // merged to the output [first, out), and returns the new end of the output. Sorted pieces are
+    // written out as soon as they are final, while they're still in cache, and runs equal to the
+    // last output element are merged straight after partition_left isolated them without being
+    // sorted any further. The element before begin may be moved from, so the last element
+    // written so far, *(out - 1), takes its role in the check for equal pivots.
+    template<class Iter, class Compare, class Reduce, bool Branchless>
+    inline Iter pdqsort_reduce_loop(Iter first, Iter out, Iter begin, Iter end, Compare comp,
+                                    Reduce& reduce, int bad_allowed) {
+        typedef typename std::iterator_traits<Iter>::difference_type diff_t;
+
+        while (true) {
+            diff_t size = end - begin;
+
+            if (size < insertion_sort_threshold) {
+                insertion_sort(begin, end, comp);
+                return reduce_sorted(first, out, begin, end, comp, reduce);
+            }
+
+            choose_pivot(begin, end, comp);
+
+            // Everything left in [begin, end) is at least *(out - 1), so a pivot equal to it means
+            // every element that partition_left puts left of the pivot is a duplicate.
+            if (out != first && !comp(*(out - 1), *begin)) {
+                Iter equal_end = partition_left(begin, end, comp) + 1;
+                for (; begin != equal_end; ++begin) reduce(*(out - 1), *begin);
+                continue;
+            }
+
+            std::pair<Iter, bool> part_result =
+                Branchless ? partition_right_branchless(begin, end, comp)
+                           : partition_right(begin, end, comp);
+            Iter pivot_pos = part_result.first;
+            bool already_partitioned = part_result.second;
+
+            diff_t l_size = pivot_pos - begin;
+            diff_t r_size = end - (pivot_pos + 1);
+            bool highly_unbalanced = l_size < size / 8 || r_size < size / 8;
+
+            if (highly_unbalanced) {
+                if (--bad_allowed == 0) {
+                    heap_sort(begin, end, comp);
+                    return reduce_sorted(first, out, begin, end, comp, reduce);
+                }
+
+                break_patterns(begin, pivot_pos, end);
+            } else {
+                if (already_partitioned && partial_insertion_sort(begin, pivot_pos, comp)
+                                        && partial_insertion_sort(pivot_pos + 1, end, comp)) {
+                    return reduce_sorted(first, out, begin, end, comp, reduce);
+                }
+            }
+
+            out = pdqsort_reduce_loop<Iter, Compare, Reduce, Branchless>(
+                first, out, begin, pivot_pos, comp, reduce, bad_allowed);
+            out = reduce_sorted(first, out, pivot_pos, pivot_pos + 1, comp, reduce);
+            begin = pivot_pos + 1;
+        }
+    }
+
+    // Branchless classifier for samplesort, after "Super Scalar Sample Sort" by Peter Sanders and
+    // Sebastian Winkel. The splitters are stored as an implicit binary search tree, so finding the
+    // bucket of an element is a fixed number of steps without any unpredictable branches. With
+    // EqualBuckets every bucket is followed by one that holds exactly the elements equal to its
+    // upper splitter, which needs no further sorting.
+    template<class T, class Compare, bool EqualBuckets>
+    struct samplesort_classifier {
+        enum { num_buckets = 1 << samplesort_log_buckets };
+
+        // tree[1, num_buckets) in heap order, splitters[0, num_buckets) sorted with the last
+        // splitter repeated, so every bucket has a splitter to compare against.
+        samplesort_classifier(const T* tree, const T* splitters, Compare comp)
+            : tree(tree), splitters(splitters), comp(comp) { }
+
+        // Classifies [begin, end) into oracle, eight elements at once so their independent tree
+        // walks overlap in the pipeline. The indices are kept in separate variables rather than
+        // an array, so they stay in registers.
+        template<class Iter>
+        void classify(Iter begin, Iter end, unsigned char* oracle) {
+            for (; end - begin >= 8; begin += 8, oracle += 8) {
+                std::size_t i0 = 1, i1 = 1, i2 = 1, i3 = 1, i4 = 1, i5 = 1, i6 = 1, i7 = 1;
+                for (int level = 0; level < samplesort_log_buckets; ++level) {
+                    i0 = 2 * i0 + comp(tree[i0], begin[0]); i1 = 2 * i1 + comp(tree[i1], begin[1]);
+                    i2 = 2 * i2 + comp(tree[i2], begin[2]); i3 = 2 * i3 + comp(tree[i3], begin[3]);
+                    i4 = 2 * i4 + comp(tree[i4], begin[4]); i5 = 2 * i5 + comp(tree[i5], begin[5]);
+                    i6 = 2 * i6 + comp(tree[i6], begin[6]); i7 = 2 * i7 + comp(tree[i7], begin[7]);
+                }
+                oracle[0] = bucket(i0, begin[0]); oracle[1] = bucket(i1, begin[1]);
+                oracle[2] = bucket(i2, begin[2]); oracle[3] = bucket(i3, begin[3]);
+                oracle[4] = bucket(i4, begin[4]); oracle[5] = bucket(i5, begin[5]);
+                oracle[6] = bucket(i6, begin[6]); oracle[7] = bucket(i7, begin[7]);
+            }
+
+            for (; begin != end; ++begin, ++oracle) {
+                std::size_t i = 1;
+                for (int level = 0; level < samplesort_log_buckets; ++level) {
+                    i = 2 * i + comp(tree[i], *begin);
+                }
+                *oracle = bucket(i, *begin);
+            }
+        }
+
+        unsigned char bucket(std::size_t leaf, const T& x) {
+            std::size_t b = leaf - num_buckets;
+            if (!EqualBuckets) return (unsigned char) b;
+
+            // The last bucket has no upper splitter, its elements are never equal to one.
+            bool equal = !comp(x, splitters[b]);
+            return (unsigned char) (2 * b + (equal & (b != num_buckets - 1)));
+        }
+
+        const T* tree;
+        const T* splitters;
+        Compare comp;
+    };
+
+    // Stores splitters[lo, hi) in heap order at tree[i].
+    template<class T>
+    inline void build_splitter_tree(T* tree, const T* splitters, std::size_t i,
+                                    std::size_t lo, std::size_t hi) {
+        if (lo >= hi) return;
+        std::size_t mid = lo + (hi - lo) / 2;
+        tree[i] = splitters[mid];
+        build_splitter_tree(tree, splitters, 2 * i, lo, mid);
+        build_splitter_tree(tree, splitters, 2 * i + 1, mid + 1, hi);
+    }
+
+    // Distributes [begin, end) into buckets with samplesort_classifier and recursively sorts the
+    // buckets, switching to pdqsort_loop for buckets below samplesort_threshold. The sample is
+    // deterministic, so crafted inputs can make it split badly. A bucket holding more than half of
+    // the range and every range after levels distribution steps also go to pdqsort_loop, which
+    // bounds the recursion depth by levels. scratch must have room for end - begin +
+    // 2 * num_buckets elements and oracle for end - begin bytes. counts must have room for
+    // levels * (2 * num_buckets + 1) bucket boundaries, one set per level, followed by
+    // 2 * num_buckets scatter positions.
+    template<class Iter, class Compare, bool Branchless>
+    inline void samplesort_loop(Iter begin, Iter end, Compare comp, bool leftmost, int levels,
+                                typename std::iterator_traits<Iter>::value_type* scratch,
+                                unsigned char* oracle, std::size_t* counts) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+        const std::size_t num_buckets = std::size_t(1) << samplesort_log_buckets;
+        std::size_t size = end - begin;
+
+        if (size < std::size_t(samplesort_threshold) || levels == 0) {
+            pdqsort_loop<Iter, Compare, Branchless>(begin, end, comp, log2(size), leftmost);
+            return;
+        }
+
+        // Sort a deterministic pseudorandom sample and take equidistant splitters from it.
+        T* tree = scratch;
+        T* splitters = scratch + num_buckets;
+        T* buffer = scratch + 2 * num_buckets;
+        std::size_t sample_size = num_buckets * samplesort_oversampling;
+        std::size_t rng = size;
+        for (std::size_t i = 0; i < sample_size; ++i) {
+            rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+            buffer[i] = begin[rng % size];
+        }
+        pdqsort_loop<T*, Compare, Branchless>(buffer, buffer + sample_size, comp,
+                                              log2(sample_size));
+
+        // Duplicate splitters mean a value is so common it should get an equality bucket.
+        bool equal_buckets = false;
+        for (std::size_t b = 0; b < num_buckets - 1; ++b) {
+            splitters[b] = buffer[(b + 1) * samplesort_oversampling];
+            equal_buckets |= b > 0 && !comp(splitters[b - 1], splitters[b]);
+        }
+        splitters[num_buckets - 1] = splitters[num_buckets - 2];
+        build_splitter_tree(tree, splitters, 1, 0, num_buckets - 1);
+
+        if (equal_buckets) {
+            samplesort_classifier<T, Compare, true>(tree, splitters, comp)
+                .classify(begin, end, oracle);
+        } else {
+            samplesort_classifier<T, Compare, false>(tree, splitters, comp)
+                .classify(begin, end, oracle);
+        }
+
+        // Scatter into the buffer by bucket and move everything back. The bucket boundaries of
+        // this level are kept until its buckets are sorted, the scatter positions are shared.
+        std::size_t* bucket_start = counts;
+        std::size_t* pos = counts + std::size_t(levels) * (2 * num_buckets + 1);
+        std::fill(bucket_start, bucket_start + 2 * num_buckets + 1, std::size_t(0));
+        for (std::size_t i = 0; i < size; ++i) ++bucket_start[oracle[i] + 1];
+        for (std::size_t b = 0; b < 2 * num_buckets; ++b) bucket_start[b + 1] += bucket_start[b];
+
+        std::copy(bucket_start, bucket_start + 2 * num_buckets, pos);
+        for (std::size_t i = 0; i < size; ++i) {
+            buffer[pos[oracle[i]]++] = PDQSORT_PREFER_MOVE(begin[i]);
+        }
+        for (std::size_t i = 0; i < size; ++i) begin[i] = PDQSORT_PREFER_MOVE(buffer[i]);
+
+        for (std::size_t b = 0; b < 2 * num_buckets; ++b) {
+            std::size_t lo = bucket_start[b], hi = bucket_start[b + 1];
+            if (hi - lo < 2 || (equal_buckets && b % 2 == 1)) continue;
+
+            // If the sample failed to split the range well, give the big bucket to pdqsort.
+            if (hi - lo > size / 2) {
+                pdqsort_loop<Iter, Compare, Branchless>(begin + lo, begin + hi, comp,
+                                                        log2(hi - lo), leftmost && lo == 0);
+                continue;
+            }
+
+            samplesort_loop<Iter, Compare, Branchless>(begin + lo, begin + hi, comp,
+                                                       leftmost && lo == 0, levels - 1, scratch,
+                                                       oracle + lo,
+                                                       counts + (2 * num_buckets + 1));
+        }
+    }
+
+    // Whether samplesort can sort T: the sample and the splitters are copies, kept in default
+    // constructed scratch memory. Before C++11 this can't be checked, and is required.
+#if __cplusplus >= 201103L
+    template<class T> struct can_samplesort
+        : std::integral_constant<bool, std::is_default_constructible<T>::value &&
+                                       std::is_copy_assignable<T>::value> { };
+#else
+    template<class T> struct can_samplesort {
+        enum { value = true };
+    };
+#endif
+
+    // Sorts a range of at least samplesort_threshold elements with samplesort_loop, allowing
+    // log_{num_buckets}(size) + 2 distribution levels, which well split ranges never need. Returns
+    // false without touching [begin, end) if the scratch memory could not be allocated. Types
+    // samplesort can't sort are given to pdqsort_loop instead, so samplesort_loop is never
+    // instantiated for them.
+    template<bool Enabled>
+    struct samplesort_large {
+        template<class Iter, class Compare, bool Branchless>
+        static bool apply(Iter begin, Iter end, Compare comp, pdqsort_context* context) {
+            typedef typename std::iterator_traits<Iter>::value_type T;
+            const std::size_t num_buckets = std::size_t(1) << samplesort_log_buckets;
+            std::size_t size = end - begin;
+
+            int levels = log2(size) / samplesort_log_buckets + 2;
+            nothrow_buffer<T> scratch(size + 2 * num_buckets, context);
+            nothrow_buffer<unsigned char> oracle(size, context);
+            nothrow_buffer<std::size_t> counts(
+                std::size_t(levels) * (2 * num_buckets + 1) + 2 * num_buckets, context);
+            if (!scratch.data || !oracle.data || !counts.data) return false;
+
+            samplesort_loop<Iter, Compare, Branchless>(begin, end, comp, true, levels,
+                                                       scratch.data, oracle.data, counts.data);
+            return true;
+        }
+    };
+
+    template<>
+    struct samplesort_large<false> {
+        template<class Iter, class Compare, bool Branchless>
+        static bool apply(Iter begin, Iter end, Compare comp, pdqsort_context*) {
+            pdqsort_loop<Iter, Compare, Branchless>(begin, end, comp, log2(end - begin));
+            return true;
+        }
+    };
+
+    // Sorts [begin, end) with samplesort, or returns false without touching [begin, end) if the
+    // scratch memory could not be allocated. Ranges below samplesort_threshold, and types
+    // samplesort can't sort, go straight to pdqsort_loop without allocating.
+    template<class Iter, class Compare, bool Branchless>
+    inline bool samplesort(Iter begin, Iter end, Compare comp, pdqsort_context* context = 0) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+        std::size_t size = end - begin;
+        if (size < std::size_t(samplesort_threshold)) {
+            pdqsort_loop<Iter, Compare, Branchless>(begin, end, comp, log2(size));
+            return true;
+        }
+
+        typedef samplesort_large<can_samplesort<T>::value> Large;
+        return Large::template apply<Iter, Compare, Branchless>(begin, end, comp, context);
+    }
+
+    // Whether an element falls in a bucket below a given one.
+    template<class Classifier>
+    struct bucket_below {
+        bucket_below(Classifier classifier, std::size_t bucket)
+            : classifier(classifier), bucket(bucket) { }
+        template<class T>
+        bool operator()(const T& x) { return std::size_t(classifier(x)) < bucket; }
+        Classifier classifier;
+        std::size_t bucket;
+    };
+
+    // Output iterator that ignores everything written to it.
+    struct discard_output {
+        discard_output& operator*() { return *this; }
+        discard_output& operator++() { return *this; }
+        template<class T> discard_output& operator=(const T&) { return *this; }
+    };
+
+    // Reorders [begin, end), whose buckets classifier(x) are all in [lo, hi), by bucket, and writes
+    // the start of every bucket in (lo, hi) as an offset from first to bucket_begins. The range is
+    // split in half by bucket with partition_blocks and both halves are bucketized recursively, so
+    // every element takes log2(hi - lo) branchless partitioning passes. That beats moving every
+    // element straight to its bucket, which costs a misprediction per element.
+    template<class Iter, class Classifier, class OffsetIter>
+    inline void bucketize(Iter first, Iter begin, Iter end, Classifier classifier,
+                          std::size_t lo, std::size_t hi, OffsetIter& bucket_begins) {
+        if (hi - lo < 2) return;
+
+        std::size_t mid = lo + (hi - lo) / 2;
+        Iter split = partition_blocks(begin, end, bucket_below<Classifier>(classifier, mid));
+        bucketize(first, begin, split, classifier, lo, mid, bucket_begins);
+        *bucket_begins = std::size_t(split - first); ++bucket_begins;
+        bucketize(first, split, end, classifier, mid, hi, bucket_begins);
+    }
+
+    // A tournament tree for merging the sorted runs [cur[i], end[i]), i < k, padded with exhausted
+    // runs to size, a power of two. Every inner node holds the run that lost the match there, so
+    // after the winner is taken only the matches on its path to the root are replayed, against the
+    // losers stored on the way, in log2(size) comparisons. Ties are won by the run with the lower
+    // rank, which is its index, so the merge is stable. Exhausted runs get a rank of at least size
+    // and point at the largest element of all runs, so they lose every match without a special
+    // case. Needs a non-empty run.
+    //
+    // For branchless comparisons the current element of every run is cached in keys, and matches
+    // are played without branches. The challenger's key and rank stay in registers, and the keys of
+    // the stored losers only depend on the path, so they can be loaded before the matches are
+    // decided. Ties take a second comparison, which is cheap next to a misprediction.
+    template<class Iter, class Compare, bool Branchless>
+    class loser_tree {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+
+    public:
+        loser_tree(Iter* cur, Iter* end, T* keys, std::size_t* ranks, std::size_t* losers,
+                   std::size_t k, std::size_t size, Compare comp)
+            : cur(cur), end(end), keys(keys), ranks(ranks), losers(losers), size(size), alive(0),
+              comp(comp) {
+            for (std::size_t i = 0; i < k; ++i) {
+                if (cur[i] == end[i]) continue;
+                if (alive++ == 0 || comp(*last, *(end[i] - 1))) last = end[i] - 1;
+            }
+
+            for (std::size_t i = 0; i < size; ++i) {
+                bool done = i >= k || cur[i] == end[i];
+                if (done) cur[i] = last;
+                ranks[i] = done ? size + i : i;
+                if (Branchless) keys[i] = *cur[i];
+            }
+
+            winner = init(1);
+        }
+
+        // Writes the merged runs to out and returns the end of the output.
+        template<class OutIter>
+        OutIter merge(OutIter out) {
+            while (alive > 1) {
+                std::size_t run = winner;
+                *out = *cur[run]; ++out;
+                if (++cur[run] == end[run]) {
+                    cur[run] = last;
+                    ranks[run] += size;
+                    --alive;
+                }
+
+                if (Branchless) replay_branchless(run);
+                else replay(run);
+            }
+
+            return std::copy(cur[winner], end[winner], out);
+        }
+
+    private:
+        // Plays the match between runs a and b and returns the winner.
+        std::size_t play(std::size_t a, std::size_t b) const {
+            std::size_t l = ranks[a] < ranks[b] ? a : b;
+            std::size_t r = l ^ a ^ b;
+            return comp(*cur[r], *cur[l]) ? r : l;
+        }
+
+        // Plays all matches below node and returns the winner.
+        std::size_t init(std::size_t node) {
+            if (node >= size) return node - size;
+            std::size_t a = init(2 * node);
+            std::size_t b = init(2 * node + 1);
+            std::size_t w = play(a, b);
+            losers[node] = w ^ a ^ b;
+            return w;
+        }
+
+        // Replays the matches from the leaf of run to the root against the stored losers.
+        void replay(std::size_t run) {
+            for (std::size_t node = size + run; node > 1; node /= 2) {
+                std::size_t other = losers[node / 2];
+                std::size_t w = play(run, other);
+                losers[node / 2] = w ^ run ^ other;
+                run = w;
+            }
+
+            winner = run;
+        }
+
+        void replay_branchless(std::size_t run) {
+            T key = keys[run] = *cur[run];
+            std::size_t rank = ranks[run];
+            for (std::size_t node = size + run; node > 1; node /= 2) {
+                std::size_t other = losers[node / 2];
+                T other_key = keys[other];
+                std::size_t other_rank = ranks[other];
+                bool won = comp(key, other_key) | ((rank < other_rank) & !comp(other_key, key));
+
+                std::size_t lost = std::size_t(0) - !won;
+                losers[node / 2] = other ^ ((other ^ run) & lost);
+                run ^= (run ^ other) & lost;
+                rank ^= (rank ^ other_rank) & lost;
+                key = won ? key : other_key;
+            }
+
+            winner = run;
+        }
+
+        Iter* cur;
+        Iter* end;
+        T* keys;
+        std::size_t* ranks;
+        std::size_t* losers;
+        std::size_t size;
+        std::size_t alive;
+        std::size_t winner;
+        Iter last;
+        Compare comp;
+    };
+
+    // Storage for the keys cached by a loser_tree of size runs, which are only needed for
+    // branchless comparisons. They are kept on the stack for up to merge_k_stack_ranges runs, and
+    // allocated otherwise, in which case data() is null if the allocation failed.
+    template<class T, bool Branchless>
+    struct loser_tree_keys {
+        explicit loser_tree_keys(std::size_t) { }
+        T* data() { return 0; }
+    };
+
+    template<class T>
+    struct loser_tree_keys<T, true> {
+        explicit loser_tree_keys(std::size_t size)
+            : heap(size > merge_k_stack_ranges ? new (std::nothrow) T[size] : 0),
+              small(size <= merge_k_stack_ranges) { }
+        ~loser_tree_keys() { delete[] heap; }
+        T* data() { return small ? stack : heap; }
+
+    private:
+        loser_tree_keys(const loser_tree_keys&);
+        loser_tree_keys& operator=(const loser_tree_keys&);
+
+        T stack[merge_k_stack_ranges];
+        T* heap;
+        bool small;
+    };
+
+    // Merges the k sorted ranges in [ranges_begin, ranges_begin + k) to out with a loser_tree. Its
+    // state is kept on the stack for up to merge_k_stack_ranges ranges, and allocated otherwise.
+    template<bool Branchless, class RangeIter, class OutIter, class Compare>
+    inline OutIter merge_k(RangeIter ranges_begin, std::size_t k, OutIter out, Compare comp) {
+        typedef typename std::iterator_traits<RangeIter>::value_type::first_type Iter;
+        typedef typename std::iterator_traits<Iter>::value_type T;
+
+        bool empty = true;
+        for (std::size_t i = 0; i < k; ++i) {
+            empty = empty && ranges_begin[i].first == ranges_begin[i].second;
+        }
+        if (empty) return out;
+
+        std::size_t size = 2;
+        while (size < k) size *= 2;
+        loser_tree_keys<T, Branchless> keys(size);
+
+        if (size <= merge_k_stack_ranges) {
+            Iter cur[merge_k_stack_ranges];
+            Iter end[merge_k_stack_ranges];
+            std::size_t ranks[merge_k_stack_ranges];
+            std::size_t losers[merge_k_stack_ranges];
+            for (std::size_t i = 0; i < k; ++i) {
+                cur[i] = ranges_begin[i].first;
+                end[i] = ranges_begin[i].second;
+            }
+
+            loser_tree<Iter, Compare, Branchless> tree(cur, end, keys.data(), ranks, losers, k,
+                                                       size, comp);
+            return tree.merge(out);
+        }
+
+        nothrow_buffer<Iter> iters(2 * size);
+        nothrow_buffer<std::size_t> indices(2 * size);
+        if (!iters.data || !indices.data || (Branchless && !keys.data())) throw std::bad_alloc();
+        for (std::size_t i = 0; i < k; ++i) {
+            iters.data[i] = ranges_begin[i].first;
+            iters.data[size + i] = ranges_begin[i].second;
+        }
+
+        loser_tree<Iter, Compare, Branchless> tree(iters.data, iters.data + size, keys.data(),
+                                                   indices.data, indices.data + size, k, size,
+                                                   comp);
+        return tree.merge(out);
+    }
+
+    // Finds for the k sorted ranges [first_i, last_i) in [ranges_begin, ranges_begin + k) how many
+    // elements of each the first rank elements of their stable merge take, and writes the end of
+    // that prefix of range i to splits[i]. Only the windows [splits[i], hi[i]) are undecided. Every
+    // step takes the middle element x of the largest window and counts the window elements that
+    // merge before it, each with a binary search, which tells if x and those elements belong to the
+    // prefix, or x and all elements after it don't. That halves the largest window every step.
+    template<class RangeIter, class SplitIter, class Iter, class Compare>
+    inline void merge_k_split(RangeIter ranges_begin, std::size_t k, std::size_t rank,
+                              SplitIter splits, Compare comp, Iter* hi, Iter* pos) {
+        for (std::size_t i = 0; i < k; ++i) {
+            splits[i] = ranges_begin[i].first;
+            hi[i] = ranges_begin[i].second;
+        }
+
+        while (true) {
+            std::size_t j = 0;
+            for (std::size_t i = 1; i < k; ++i) {
+                if (hi[i] - splits[i] > hi[j] - splits[j]) j = i;
+            }
+            if (hi[j] == splits[j]) return;
+
+            Iter x = splits[j] + (hi[j] - splits[j]) / 2;
+            std::size_t before = 0;
+            for (std::size_t i = 0; i < k; ++i) {
+                // Equal elements of earlier ranges merge before x, of later ranges after it.
+                if (i < j) pos[i] = std::upper_bound(Iter(splits[i]), hi[i], *x, comp);
+                else if (i > j) pos[i] = std::lower_bound(Iter(splits[i]), hi[i], *x, comp);
+                else pos[i] = x;
+                before += std::size_t(pos[i] - splits[i]);
+            }
+
+            if (before < rank) {
+                rank -= before + 1;
+                for (std::size_t i = 0; i < k; ++i) splits[i] = pos[i];
+                splits[j] = x + 1;
+            } else {
+                for (std::size_t i = 0; i < k; ++i) hi[i] = pos[i];
+            }
+        }
+    }
+
+#if __cplusplus >= 201103L
+    // Sorts *a and *b. For branchless comparisons both results are selected without a branch,
+    // which compiles to a min and a max for arithmetic types.
+    template<class Iter, class Compare>
+    inline PDQSORT_CONSTEXPR void compare_exchange(Iter a, Iter b, Compare& comp, std::true_type) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+        T x = *a;
+        T y = *b;
+        bool swap = comp(y, x);
+        *a = swap ? y : x;
+        *b = swap ? x : y;
+    }
+
+    template<class Iter, class Compare>
+    inline PDQSORT_CONSTEXPR void compare_exchange(Iter a, Iter b, Compare& comp, std::false_type) {
+        sort2(a, b, comp);
+    }
+
+    // A sorting network as a list of compare-exchange pairs a0, b0, a1, b1, ... with a < b,
+    // unrolled at compile time. Pairs with b >= N are skipped. That's the network with the missing
+    // elements taken to be larger than all others, which still sorts the first N elements.
+    template<std::size_t... Pairs> struct sorting_network {
+        template<std::size_t N, class Iter, class Compare, class Branchless>
+        static PDQSORT_CONSTEXPR void apply(Iter, Compare&, Branchless) { }
+    };
+
+    template<std::size_t A, std::size_t B, std::size_t... Pairs>
+    struct sorting_network<A, B, Pairs...> {
+        template<std::size_t N, class Iter, class Compare, class Branchless>
+        static PDQSORT_CONSTEXPR void apply(Iter begin, Compare& comp, Branchless branchless) {
+            if (B < N) compare_exchange(begin + A, begin + B, comp, branchless);
+            sorting_network<Pairs...>::template apply<N>(begin, comp, branchless);
+        }
+    };
+
+    // The smallest known sorting networks for up to 16 elements, one layer of independent
+    // compare-exchanges after the other. 13 and 15 elements use the network for 16, which is one
+    // compare-exchange more than the smallest known for 13 and as small as the one for 15.
+    template<std::size_t N> struct fixed_network;
+    template<> struct fixed_network<2> {
+        typedef sorting_network<0, 1> type;
+    };
+    template<> struct fixed_network<3> {
+        typedef sorting_network<0, 2, 0, 1, 1, 2> type;
+    };
+    template<> struct fixed_network<4> {
+        typedef sorting_network<0, 2, 1, 3, 0, 1, 2, 3, 1, 2> type;
+    };
+    template<> struct fixed_network<5> {
+        typedef sorting_network<0, 3, 1, 4, 0, 2, 1, 3, 0, 1, 2, 4, 1, 2, 3, 4, 2, 3> type;
+    };
+    template<> struct fixed_network<6> {
+        typedef sorting_network<0, 5, 1, 3, 2, 4, 1, 2, 3, 4, 0, 3, 2, 5, 0, 1, 2, 3, 4, 5,
+                                1, 2, 3, 4> type;
+    };
+    template<> struct fixed_network<7> {
+        typedef sorting_network<0, 6, 2, 3, 4, 5, 0, 2, 1, 4, 3, 6, 0, 1, 2, 5, 3, 4, 1, 2, 4, 6,
+                                2, 3, 4, 5, 1, 2, 3, 4, 5, 6> type;
+    };
+    template<> struct fixed_network<8> {
+        typedef sorting_network<0, 2, 1, 3, 4, 6, 5, 7, 0, 4, 1, 5, 2, 6, 3, 7,
+                                0, 1, 2, 3, 4, 5, 6, 7, 2, 4, 3, 5, 1, 4, 3, 6,
+                                1, 2, 3, 4, 5, 6> type;
+    };
+    template<> struct fixed_network<9> {
+        typedef sorting_network<0, 3, 1, 7, 2, 5, 4, 8, 0, 7, 2, 4, 3, 8, 5, 6,
+                                0, 2, 1, 3, 4, 5, 7, 8, 1, 4, 3, 6, 5, 7, 0, 1, 2, 4, 3, 5, 6, 8,
+                                2, 3, 4, 5, 6, 7, 1, 2, 3, 4, 5, 6> type;
+    };
+    template<> struct fixed_network<10> {
+        typedef sorting_network<0, 8, 1, 9, 2, 7, 3, 5, 4, 6, 0, 2, 1, 4, 5, 8, 7, 9,
+                                0, 3, 2, 4, 5, 7, 6, 9, 0, 1, 3, 6, 8, 9, 1, 5, 2, 3, 4, 8, 6, 7,
+                                1, 2, 3, 5, 4, 6, 7, 8, 2, 3, 4, 5, 6, 7, 3, 4, 5, 6> type;
+    };
+    template<> struct fixed_network<11> {
+        typedef sorting_network<0, 9, 1, 6, 2, 4, 3, 7, 5, 8, 0, 1, 3, 5, 4, 10, 6, 9, 7, 8,
+                                1, 3, 2, 5, 4, 7, 8, 10, 0, 4, 1, 2, 3, 7, 5, 9, 6, 8,
+                                0, 1, 2, 6, 4, 5, 7, 8, 9, 10, 2, 4, 3, 6, 5, 7, 8, 9,
+                                1, 2, 3, 4, 5, 6, 7, 8, 2, 3, 4, 5, 6, 7> type;
+    };
+    template<> struct fixed_network<12> {
+        typedef sorting_network<0, 8, 1, 7, 2, 6, 3, 11, 4, 10, 5, 9,
+                                0, 1, 2, 5, 3, 4, 6, 9, 7, 8, 10, 11, 0, 2, 1, 6, 5, 10, 9, 11,
+                                0, 3, 1, 2, 4, 6, 5, 7, 8, 11, 9, 10, 1, 4, 3, 5, 6, 8, 7, 10,
+                                1, 3, 2, 5, 6, 9, 8, 10, 2, 3, 4, 5, 6, 7, 8, 9, 4, 6, 5, 7,
+                                3, 4, 5, 6, 7, 8> type;
+    };
+    template<> struct fixed_network<14> {
+        typedef sorting_network<0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,
+                                0, 2, 1, 3, 4, 8, 5, 9, 10, 12, 11, 13,
+                                0, 4, 1, 2, 3, 7, 5, 8, 6, 10, 9, 13, 11, 12,
+                                0, 6, 1, 5, 3, 9, 4, 10, 7, 13, 8, 12, 2, 10, 3, 11, 4, 6, 7, 9,
+                                1, 3, 2, 8, 5, 11, 6, 7, 10, 12,
+                                1, 4, 2, 6, 3, 5, 7, 11, 8, 10, 9, 12,
+                                2, 4, 3, 6, 5, 8, 7, 10, 9, 11, 3, 4, 5, 6, 7, 8, 9, 10, 6, 7> type;
+    };
+    template<> struct fixed_network<16> {
+        typedef sorting_network<0, 13, 1, 12, 2, 15, 3, 14, 4, 8, 5, 6, 7, 11, 9, 10,
+                                0, 5, 1, 7, 2, 9, 3, 4, 6, 13, 8, 14, 10, 15, 11, 12,
+                                0, 1, 2, 3, 4, 5, 6, 8, 7, 9, 10, 11, 12, 13, 14, 15,
+                                0, 2, 1, 3, 4, 10, 5, 11, 6, 7, 8, 9, 12, 14, 13, 15,
+                                1, 2, 3, 12, 4, 6, 5, 7, 8, 10, 9, 11, 13, 14,
+                                1, 4, 2, 6, 5, 8, 7, 10, 9, 13, 11, 14, 2, 4, 3, 6, 9, 12, 11, 13,
+                                3, 5, 6, 8, 7, 9, 10, 12, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                6, 7, 8, 9> type;
+    };
+    template<> struct fixed_network<13> : fixed_network<16> { };
+    template<> struct fixed_network<15> : fixed_network<16> { };
+
+    // Batcher's odd-even merge of the sorted halves of [Lo, Hi], comparing elements R apart. As
+    // with sorting_network, comparisons with elements at or beyond N are skipped.
+    template<std::size_t Lo, std::size_t Hi, std::size_t R, bool Last = (2 * R >= Hi - Lo)>
+    struct odd_even_merge {
+        template<std::size_t N, class Iter, class Compare, class Branchless>
+        static PDQSORT_CONSTEXPR void apply(Iter begin, Compare& comp, Branchless branchless) {
+            if (Lo + R < N) compare_exchange(begin + Lo, begin + (Lo + R), comp, branchless);
+        }
+    };
+
+    template<std::size_t I, std::size_t Hi, std::size_t R, bool Last = (I + R >= Hi)>
+    struct odd_even_merge_step {
+        template<std::size_t N, class Iter, class Compare, class Branchless>
+        static PDQSORT_CONSTEXPR void apply(Iter begin, Compare& comp, Branchless branchless) {
+            if (I + R < N) compare_exchange(begin + I, begin + (I + R), comp, branchless);
+            odd_even_merge_step<I + 2 * R, Hi, R>::template apply<N>(begin, comp, branchless);
+        }
+    };
+
+    template<std::size_t I, std::size_t Hi, std::size_t R>
+    struct odd_even_merge_step<I, Hi, R, true> {
+        template<std::size_t N, class Iter, class Compare, class Branchless>
+        static PDQSORT_CONSTEXPR void apply(Iter, Compare&, Branchless) { }
+    };
+
+    template<std::size_t Lo, std::size_t Hi, std::size_t R>
+    struct odd_even_merge<Lo, Hi, R, false> {
+        template<std::size_t N, class Iter, class Compare, class Branchless>
+        static PDQSORT_CONSTEXPR void apply(Iter begin, Compare& comp, Branchless branchless) {
+            odd_even_merge<Lo, Hi, 2 * R>::template apply<N>(begin, comp, branchless);
+            odd_even_merge<Lo + R, Hi, 2 * R>::template apply<N>(begin, comp, branchless);
+            odd_even_merge_step<Lo + R, Hi, R>::template apply<N>(begin, comp, branchless);
+        }
+    };
+
+    // Sorts [begin, begin + N) with a sorting network. Up to 16 elements use fixed_network, up to
+    // 32 sort the first 16 and the rest separately and merge them with odd_even_merge, which
+    // together takes as many compare-exchanges as the smallest known network for 32.
+    template<std::size_t N, bool Small = (N <= 16)> struct fixed_sort;
+
+    template<std::size_t N>
+    struct fixed_sort<N, true> {
+        template<class Iter, class Compare, class Branchless>
+        static PDQSORT_CONSTEXPR void apply(Iter begin, Compare& comp, Branchless branchless) {
+            fixed_network<N>::type::template apply<N>(begin, comp, branchless);
+        }
+    };
+
+    template<> struct fixed_sort<0, true> {
+        template<class Iter, class Compare, class Branchless>
+        static PDQSORT_CONSTEXPR void apply(Iter, Compare&, Branchless) { }
+    };
+
+    template<> struct fixed_sort<1, true> : fixed_sort<0, true> { };
+
+    template<std::size_t N>
+    struct fixed_sort<N, false> {
+        template<class Iter, class Compare, class Branchless>
+        static PDQSORT_CONSTEXPR void apply(Iter begin, Compare& comp, Branchless branchless) {
+            fixed_sort<16>::apply(begin, comp, branchless);
+            fixed_sort<N - 16>::apply(begin + 16, comp, branchless);
+            odd_even_merge<0, 31, 1>::template apply<N>(begin, comp, branchless);
+        }
+    };
+
+    // Sorts the segments of pdqsort_segmented whose indices are in [first, last), all of which
+    // have N elements, with fixed_sort<N>.
+    template<std::size_t N>
+    struct fixed_segments {
+        template<class Iter, class OffsetIter, class Compare, class Branchless>
+        static void apply(Iter data, OffsetIter offsets, const std::size_t* first,
+                          const std::size_t* last, Compare& comp, Branchless branchless) {
+            for (; first != last; ++first) {
+                fixed_sort<N>::apply(data + offsets[*first], comp, branchless);
+            }
+        }
+    };
+
+    // Sorts segments of size elements, 2 <= size <= fixed_network_max_size, as above. The switch
+    // is done once per size, so every segment of a size runs the same straight-line network.
+    template<class Iter, class OffsetIter, class Compare, class Branchless>
+    inline void sort_fixed_segments(std::size_t size, Iter data, OffsetIter offsets,
+                                    const std::size_t* first, const std::size_t* last,
+                                    Compare& comp, Branchless b) {
+        switch (size) {
+        case 2: fixed_segments<2>::apply(data, offsets, first, last, comp, b); break;
+        case 3: fixed_segments<3>::apply(data, offsets, first, last, comp, b); break;
+        case 4: fixed_segments<4>::apply(data, offsets, first, last, comp, b); break;
+        case 5: fixed_segments<5>::apply(data, offsets, first, last, comp, b); break;
+        case 6: fixed_segments<6>::apply(data, offsets, first, last, comp, b); break;
+        case 7: fixed_segments<7>::apply(data, offsets, first, last, comp, b); break;
+        case 8: fixed_segments<8>::apply(data, offsets, first, last, comp, b); break;
+        case 9: fixed_segments<9>::apply(data, offsets, first, last, comp, b); break;
+        case 10: fixed_segments<10>::apply(data, offsets, first, last, comp, b); break;
+        case 11: fixed_segments<11>::apply(data, offsets, first, last, comp, b); break;
+        case 12: fixed_segments<12>::apply(data, offsets, first, last, comp, b); break;
+        case 13: fixed_segments<13>::apply(data, offsets, first, last, comp, b); break;
+        case 14: fixed_segments<14>::apply(data, offsets, first, last, comp, b); break;
+        case 15: fixed_segments<15>::apply(data, offsets, first, last, comp, b); break;
+        case 16: fixed_segments<16>::apply(data, offsets, first, last, comp, b); break;
+        case 17: fixed_segments<17>::apply(data, offsets, first, last, comp, b); break;
+        case 18: fixed_segments<18>::apply(data, offsets, first, last, comp, b); break;
+        case 19: fixed_segments<19>::apply(data, offsets, first, last, comp, b); break;
+        case 20: fixed_segments<20>::apply(data, offsets, first, last, comp, b); break;
+        case 21: fixed_segments<21>::apply(data, offsets, first, last, comp, b); break;
+        case 22: fixed_segments<22>::apply(data, offsets, first, last, comp, b); break;
+        case 23: fixed_segments<23>::apply(data, offsets, first, last, comp, b); break;
+        case 24: fixed_segments<24>::apply(data, offsets, first, last, comp, b); break;
+        case 25: fixed_segments<25>::apply(data, offsets, first, last, comp, b); break;
+        case 26: fixed_segments<26>::apply(data, offsets, first, last, comp, b); break;
+        case 27: fixed_segments<27>::apply(data, offsets, first, last, comp, b); break;
+        case 28: fixed_segments<28>::apply(data, offsets, first, last, comp, b); break;
+        case 29: fixed_segments<29>::apply(data, offsets, first, last, comp, b); break;
+        case 30: fixed_segments<30>::apply(data, offsets, first, last, comp, b); break;
+        case 31: fixed_segments<31>::apply(data, offsets, first, last, comp, b); break;
+        case 32: fixed_segments<32>::apply(data, offsets, first, last, comp, b); break;
+        }
+    }
+
+    // 1 if Compare orders T ascending with the built-in operators, -1 if descending, 0 otherwise.
+    template<class Compare, class T> struct compare_direction : std::integral_constant<int, 0> { };
+    template<class T> struct compare_direction<std::less<T>, T>
+        : std::integral_constant<int, 1> { };
+    template<class T> struct compare_direction<std::less<void>, T>
+        : std::integral_constant<int, 1> { };
+    template<class T> struct compare_direction<std::greater<T>, T>
+        : std::integral_constant<int, -1> { };
+    template<class T> struct compare_direction<std::greater<void>, T>
+        : std::integral_constant<int, -1> { };
+#if defined(__cpp_lib_ranges) && __cpp_lib_ranges >= 201911L
+    template<class T> struct compare_direction<std::ranges::less, T>
+        : std::integral_constant<int, 1> { };
+    template<class T> struct compare_direction<std::ranges::greater, T>
+        : std::integral_constant<int, -1> { };
+#endif
+
+    // Types pdqsort_auto can count or radix sort, if they are compared by compare_direction.
+    template<class T> struct is_integer_key
+        : std::integral_constant<bool, std::is_integral<T>::value || std::is_enum<T>::value> { };
+
+    // Sorts integers or enums whose normalized keys lie in [lo, lo + range) by counting how often
+    // every key occurs, and writing that many copies of it back. Returns false if the counts can't
+    // be allocated.
+    template<class Iter, class U>
+    inline bool counting_sort(Iter begin, Iter end, U lo, std::size_t range, bool descending) {
+        typedef normalized_field<typename std::iterator_traits<Iter>::value_type> Field;
+
+        nothrow_buffer<std::size_t> counts(range);
+        if (!counts.data) return false;
+        std::fill(counts.data, counts.data + range, std::size_t(0));
+        for (Iter it = begin; it != end; ++it) ++counts.data[std::size_t(U(Field::get(*it) - lo))];
+
+        for (std::size_t i = 0; i < range; ++i) {
+            std::size_t key = descending ? range - 1 - i : i;
+            begin = std::fill_n(begin, counts.data[key], Field::put(U(lo + key)));
+        }
+        return true;
+    }
+
+    // Stably moves the size elements at src to dst ordered by the byte at shift of their normalized
+    // key minus lo, xored by flip. offsets holds where the elements with every byte go.
+    template<class Field, class SrcIter, class DstIter>
+    inline void radix_pass(SrcIter src, std::size_t size, DstIter dst, std::size_t* offsets,
+                           typename Field::U lo, int shift, unsigned flip) {
+        typedef typename Field::U U;
+        for (std::size_t i = 0; i < size; ++i) {
+            unsigned byte = (unsigned(U(Field::get(src[i]) - lo) >> shift) & 0xff) ^ flip;
+            dst[offsets[byte]++] = src[i];
+        }
+    }
+
+    // Sorts integers or enums whose normalized keys lie in [lo, lo + span] with an LSD radix sort.
+    // All byte histograms are made in one pass, after which there is one pass per byte in which
+    // keys differ, alternating between [begin, end) and a buffer. Returns false if the buffer can't
+    // be allocated.
+    template<class Iter, class U>
+    inline bool radix_sort(Iter begin, Iter end, U lo, U span, bool descending) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+        typedef normalized_field<T> Field;
+
+        int bytes = 0;
+        while (bytes < int(sizeof(U)) && U(span >> (8 * bytes)) != 0) ++bytes;
+        if (bytes == 0) return true;
+
+        std::size_t size = end - begin;
+        nothrow_buffer<T> buffer(size);
+        if (!buffer.data) return false;
+
+        std::size_t counts[sizeof(U)][256];
+        std::memset(counts, 0, sizeof(counts));
+        for (Iter it = begin; it != end; ++it) {
+            U key = U(Field::get(*it) - lo);
+            for (int b = 0; b < bytes; ++b) ++counts[b][unsigned(key >> (8 * b)) & 0xff];
+        }
+
+        unsigned flip = descending ? 0xff : 0;
+        for (int b = 0; b < bytes; ++b) {
+            std::size_t offsets[256];
+            std::size_t sum = 0;
+            for (unsigned i = 0; i < 256; ++i) {
+                offsets[i] = sum;
+                sum += counts[b][i ^ flip];
+            }
+
+            if (b % 2 == 0) {
+                radix_pass<Field>(begin, size, buffer.data, offsets, lo, 8 * b, flip);
+            } else {
+                radix_pass<Field>(buffer.data, size, begin, offsets, lo, 8 * b, flip);
+            }
+        }
+
+        if (bytes % 2) std::copy(buffer.data, buffer.data + size, begin);
+        return true;
+    }
+
+    // Returns the length of the sorted prefix of [begin, end).
+    template<class Iter, class Compare>
+    inline std::size_t sorted_prefix(Iter begin, Iter end, Compare comp) {
+        if (begin == end) return 0;
+        Iter it = begin;
+        while (++it != end && !comp(*it, *(it - 1)));
+        return it - begin;
+    }
+
+    // Splits [begin, end) into sorted runs, the first of which ends at first_end, and stores them
+    // in runs. Returns their number, or 0 if there are more than max_runs.
+    template<class Iter, class Compare>
+    inline std::size_t find_runs(Iter begin, Iter first_end, Iter end, Compare comp,
+                                 std::pair<Iter, Iter>* runs, std::size_t max_runs) {
+        std::size_t num_runs = 0;
+        Iter run_begin = begin;
+        Iter it = first_end;
+        while (true) {
+            if (num_runs == max_runs) return 0;
+            runs[num_runs++] = std::make_pair(run_begin, it);
+            if (it == end) return num_runs;
+
+            run_begin = it;
+            while (++it != end && !comp(*it, *(it - 1)));
+        }
+    }
+
+    // Returns the number of distinct values among sample_size evenly spaced elements of
+    // [begin, end), which must hold at least that many.
+    template<class Iter, class Compare>
+    inline std::size_t sample_distinct(Iter begin, Iter end, Compare comp,
+                                       std::size_t sample_size) {
+        std::size_t size = end - begin;
+        std::size_t sample[auto_sample_size];
+        for (std::size_t i = 0; i < sample_size; ++i) sample[i] = i * (size / sample_size);
+
+        indirect_compare<Iter, Compare> index_comp(begin, comp);
+        insertion_sort(sample, sample + sample_size, index_comp);
+
+        std::size_t distinct = 1;
+        for (std::size_t i = 1; i < sample_size; ++i) {
+            distinct += index_comp(sample[i - 1], sample[i]);
+        }
+        return distinct;
+    }
+
+    // The part of pdqsort_auto's decision that depends on T being an integer or enum, which is only
+    // considered if Integer is set. Remembers the key range for the sort that follows.
+    template<class T, bool Integer>
+    struct integer_engine {
+        template<class Iter, class Compare>
+        pdqsort_engine choose(Iter, Iter, Compare, pdqsort_decision&) {
+            return pdqsort_engine_pdqsort;
+        }
+
+        template<class Iter>
+        bool sort(Iter, Iter, pdqsort_engine, bool) { return false; }
+    };
+
+    template<class T>
+    struct integer_engine<T, true> {
+        typedef normalized_field<T> Field;
+        typedef typename Field::U U;
+
+        // Finds the smallest and largest key. Keys in a small enough range are counted, many keys
+        // that differ in few enough bytes are radix sorted unless a sample shows few distinct
+        // values.
+        template<class Iter, class Compare>
+        pdqsort_engine choose(Iter begin, Iter end, Compare comp, pdqsort_decision& decision) {
+            U hi = lo = Field::get(*begin);
+            for (Iter it = begin + 1; it != end; ++it) {
+                U key = Field::get(*it);
+                lo = key < lo ? key : lo;
+                hi = key > hi ? key : hi;
+            }
+
+            span = U(hi - lo);
+            decision.key_bits = span ? log2(span) + 1 : 0;
+            if (span < U(counting_sort_max_range) && std::size_t(span) < decision.size) {
+                return pdqsort_engine_counting;
+            }
+            if (decision.size < radix_sort_threshold ||
+                decision.key_bits > 8 * radix_sort_max_bytes) {
+                return pdqsort_engine_pdqsort;
+            }
+
+            decision.sample_size = auto_sample_size;
+            decision.sample_distinct = sample_distinct(begin, end, comp, auto_sample_size);
+            return decision.sample_distinct > auto_few_distinct ? pdqsort_engine_radix
+                                                                : pdqsort_engine_pdqsort;
+        }
+
+        template<class Iter>
+        bool sort(Iter begin, Iter end, pdqsort_engine engine, bool descending) {
+            if (engine == pdqsort_engine_counting) {
+                return counting_sort(begin, end, lo, std::size_t(span) + 1, descending);
+            }
+            return radix_sort(begin, end, lo, span, descending);
+        }
+
+        U lo;
+        U span;
+    };
+
+    // Types pdqsort_auto can merge the runs of. pdq_merge_k copies them into a default constructed
+    // buffer, from which they are moved back.
+    template<class T> struct is_mergeable
+        : std::integral_constant<bool, std::is_default_constructible<T>::value &&
+                                       std::is_copy_assignable<T>::value> { };
+
+    // The part of pdqsort_auto's decision that merges a few sorted runs, which is only considered
+    // if Mergeable is set. Remembers the runs for the merge that follows.
+    template<class Iter, bool Mergeable>
+    struct runs_engine {
+        template<class Compare>
+        std::size_t find(Iter, Iter, Iter, Compare) { return 0; }
+
+        template<class Compare>
+        bool sort(Iter, std::size_t, Compare) { return false; }
+    };
+
+    template<class Iter>
+    struct runs_engine<Iter, true> {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+
+        template<class Compare>
+        std::size_t find(Iter begin, Iter first_end, Iter end, Compare comp) {
+            num_runs = find_runs(begin, first_end, end, comp, runs, auto_max_runs);
+            return num_runs;
+        }
+
+        // Merges the runs into a buffer and moves them back to begin. Returns false if the buffer
+        // can't be allocated.
+        template<class Compare>
+        bool sort(Iter begin, std::size_t size, Compare comp) {
+            nothrow_buffer<T> buffer(size);
+            if (!buffer.data) return false;
+            pdq_merge_k(runs, runs + num_runs, buffer.data, comp);
+            std::move(buffer.data, buffer.data + size, begin);
+            return true;
+        }
+
+        std::pair<Iter, Iter> runs[auto_max_runs];
+        std::size_t num_runs;
+    };
+
+    // Decides how pdqsort_auto sorts [begin, end), checking the cheapest and most telling
+    // properties first.
+    template<class Iter, class Compare, class RunsEngine, class IntegerEngine>
+    inline pdqsort_decision choose_engine(Iter begin, Iter end, Compare comp,
+                                          RunsEngine& runs, IntegerEngine& integer) {
+        pdqsort_decision decision = {
+            pdqsort_engine_pdqsort, std::size_t(end - begin), 0, 0, 0, 0, -1
+        };
+        if (decision.size < auto_threshold) return decision;
+
+        decision.sorted_prefix = sorted_prefix(begin, end, comp);
+        if (decision.sorted_prefix == decision.size) {
+            decision.engine = pdqsort_engine_none;
+            return decision;
+        }
+
+        if (decision.size - decision.sorted_prefix <= decision.size / auto_append_ratio) {
+            decision.engine = pdqsort_engine_append;
+            return decision;
+        }
+
+        decision.runs = runs.find(begin, begin + decision.sorted_prefix, end, comp);
+        if (decision.runs) {
+            decision.engine = pdqsort_engine_runs;
+            return decision;
+        }
+
+        decision.engine = integer.choose(begin, end, comp, decision);
+        return decision;
+    }
+#endif
+}
+
+
+#if __cplusplus >= 201103L
+// Whether pdqsort may use branchless partitioning when sorting elements of type T with Compare.
+// Branchless partitioning is always correct, but only faster if comparisons don't branch. This is
+// detected for the default comparators on arithmetic types, pointers, enums and pairs and tuples of
+// those. Specialize it for your own comparators, e.g. one that compares a single integer field:
+//
+//     template<> struct pdqsort_branchless_safe<by_timestamp, event> : std::true_type { };
+template<class Compare, class T>
+struct pdqsort_branchless_safe
+    : std::integral_constant<bool,
+        pdqsort_detail::is_default_compare<Compare>::value &&
+        pdqsort_detail::is_branchless_key<T>::value> { };
+#endif
+
+
+template<class Iter, class Compare>
+inline PDQSORT_CONSTEXPR void pdqsort(Iter begin, Iter end, Compare comp) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    if (begin == end) return;
+
+    // Big elements are cheaper to sort through an array of indices.
+    if (sizeof(T) > pdqsort_detail::indirect_sort_threshold && !PDQSORT_IS_CONSTANT_EVALUATED() &&
+        end - begin > pdqsort_detail::insertion_sort_threshold &&
+        pdqsort_detail::sort_indirect(begin, end, comp)) return;
+
+#if __cplusplus >= 201103L
+    pdqsort_detail::pdqsort_loop<Iter, Compare,
+        pdqsort_branchless_safe<typename std::decay<Compare>::type, T>::value>(
+        begin, end, comp, pdqsort_detail::log2(end - begin));
+#else
+    pdqsort_detail::pdqsort_loop<Iter, Compare, false>(
+        begin, end, comp, pdqsort_detail::log2(end - begin));
+#endif
+}
+
+template<class Iter>
+inline PDQSORT_CONSTEXPR void pdqsort(Iter begin, Iter end) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    pdqsort(begin, end, std::less<T>());
+}
+
+#if __cplusplus >= 201103L
+// Like pdqsort, but may use the caller supplied scratch buffer of buffer_size elements to partition
+// out of place. Partitions larger than the buffer are partitioned in place as usual, so any buffer
+// size works and no memory is allocated. The out of place partition is branchless and only beats
+// partitioning in place if the latter has to branch, and it copies every element, so the buffer is
+// only used for trivially copyable types that don't already get branchless partitioning.
+template<class Iter, class Compare>
+inline void pdqsort(Iter begin, Iter end, Compare comp,
+                    typename std::iterator_traits<Iter>::value_type* buffer,
+                    std::size_t buffer_size) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    if (begin == end) return;
+
+    const bool branchless = pdqsort_branchless_safe<typename std::decay<Compare>::type, T>::value;
+    if (branchless || !std::is_trivially_copyable<T>::value) buffer_size = 0;
+    pdqsort_detail::pdqsort_loop<Iter, Compare, branchless>(
+        begin, end, comp, pdqsort_detail::log2(end - begin), true, buffer, buffer_size);
+}
+
+// Like pdqsort, but takes the index array for big elements and a scratch buffer for out of place
+// partitioning, as in the overload above, from the scratch memory of context.
+template<class Iter, class Compare>
+inline void pdqsort(Iter begin, Iter end, Compare comp, pdqsort_context& context) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    if (begin == end) return;
+    std::size_t size = end - begin;
+    pdqsort_detail::count_sort(context, size);
+
+    if (sizeof(T) > pdqsort_detail::indirect_sort_threshold &&
+        size > pdqsort_detail::insertion_sort_threshold &&
+        pdqsort_detail::sort_indirect(begin, end, comp, &context)) return;
+
+    const bool branchless = pdqsort_branchless_safe<typename std::decay<Compare>::type, T>::value;
+    if (!branchless && std::is_trivially_copyable<T>::value &&
+        size > pdqsort_detail::insertion_sort_threshold) {
+        pdqsort_detail::nothrow_buffer<T> buffer(size, &context);
+        pdqsort_detail::pdqsort_loop<Iter, Compare, false>(
+            begin, end, comp, pdqsort_detail::log2(size), true, buffer.data,
+            buffer.data ? size : 0);
+        return;
+    }
+
+    pdqsort_detail::pdqsort_loop<Iter, Compare, branchless>(begin, end, comp,
+                                                             pdqsort_detail::log2(size));
+}
+#endif
+
+template<class Iter, class Compare>
+inline PDQSORT_CONSTEXPR void pdqsort_branchless(Iter begin, Iter end, Compare comp) {
+    if (begin == end) return;
+    pdqsort_detail::pdqsort_loop<Iter, Compare, true>(
         begin, end, comp, pdqsort_detail::log2(end - begin));
+}
+
+template<class Iter>
+inline PDQSORT_CONSTEXPR void pdqsort_branchless(Iter begin, Iter end) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    pdqsort_branchless(begin, end, std::less<T>());
+}
+
+// Sorts a copy of [first, last) into [d_first, d_first + (last - first)) and returns the end of the
+// output, like std::copy followed by pdqsort, but leaving the source untouched. It must not overlap
+// the output. Sorted input is only copied. Only for types that aren't trivially copyable (C++11)
+// the first partition is done while copying, so every element is copied once instead of being
+// copied and then moved around by the partition. Trivially copyable types, and all types before
+// C++11, are just copied and sorted in place: the block partition in place is as fast as any fused
+// copy and partition, so for them this is std::copy and pdqsort after the check for sorted input.
+template<class InIter, class OutIter, class Compare>
+inline OutIter pdqsort_copy(InIter first, InIter last, OutIter d_first, Compare comp) {
+    typedef typename std::iterator_traits<InIter>::value_type T;
+    typedef typename std::iterator_traits<OutIter>::difference_type diff_t;
+    diff_t size = last - first;
+    OutIter d_last = d_first + size;
+
+#if __cplusplus >= 201103L
+    const bool fused = !std::is_trivially_copyable<T>::value;
+#else
+    const bool fused = false;
+#endif
+
+    // Sorted input only needs to be copied. The check stops at the first descent, so it costs next
+    // to nothing on unsorted input.
+    if (pdqsort_detail::is_sorted(first, last, comp)) return std::copy(first, last, d_first);
+
+    // Small and big elements are better off copied first and sorted as usual.
+    if (!fused || size < pdqsort_detail::insertion_sort_threshold ||
+        sizeof(T) > pdqsort_detail::indirect_sort_threshold) {
+        std::copy(first, last, d_first);
+        pdqsort(d_first, d_last, comp);
+        return d_last;
+    }
+
+    InIter pivot_it = pdqsort_detail::choose_pivot_copy(first, last, comp);
+    OutIter pivot_pos = pdqsort_detail::partition_copy_right(first, last, pivot_it, d_first, comp);
+
+    // Nothing in the right partition is smaller than the pivot before it, so it is sorted like a
+    // right partition in pdqsort_loop, which filters out elements equal to the pivot.
+    int bad_allowed = pdqsort_detail::log2(size);
+    pdqsort_detail::pdqsort_loop<OutIter, Compare, false>(d_first, pivot_pos, comp, bad_allowed);
+    pdqsort_detail::pdqsort_loop<OutIter, Compare, false>(pivot_pos + 1, d_last, comp,
+                                                           bad_allowed, false);
+    return d_last;
+}
+
+template<class InIter, class OutIter>
+inline OutIter pdqsort_copy(InIter first, InIter last, OutIter d_first) {
+    typedef typename std::iterator_traits<InIter>::value_type T;
+    return pdqsort_copy(first, last, d_first, std::less<T>());
+}
+
+// Sorts [begin, end) given that [begin, mid) is already sorted, e.g. after appending a batch of
+// elements to a sorted array. Only the m elements of [mid, end) are sorted, after which they are
+// merged into the prefix with merge_tail, which takes O(n + m log m) time instead of O(n log n). It
+// needs room for m elements, and falls back to std::inplace_merge if that can't be allocated.
+// Elements of the prefix stay before equal elements of the tail.
+template<class Iter, class Compare>
+inline void pdqsort_append(Iter begin, Iter mid, Iter end, Compare comp) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    if (mid == end) return;
+    pdqsort(mid, end, comp);
+    if (begin == mid || !comp(*mid, *(mid - 1))) return;
+
+    std::size_t size = end - mid;
+    pdqsort_detail::raw_buffer<T> buffer(size);
+    if (!buffer.data) {
+        std::inplace_merge(begin, mid, end, comp);
+        return;
+    }
+
+    for (std::size_t i = 0; i < size; ++i) buffer.push_back(mid[i]);
+    pdqsort_detail::merge_tail(begin, mid, buffer.data, size, comp);
+}
+
+template<class Iter>
+inline void pdqsort_append(Iter begin, Iter mid, Iter end) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    pdqsort_append(begin, mid, end, std::less<T>());
+}
+
+template<class Iter, class Compare>
+inline void pdqsort_indirect(Iter begin, Iter end, Compare comp) {
+    if (begin == end) return;
+    if (!pdqsort_detail::sort_indirect(begin, end, comp)) {
+        pdqsort_detail::pdqsort_loop<Iter, Compare, false>(
+            begin, end, comp, pdqsort_detail::log2(end - begin));
+    }
+}
+
+template<class Iter>
+inline void pdqsort_indirect(Iter begin, Iter end) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    pdqsort_indirect(begin, end, std::less<T>());
+}
+
+#if __cplusplus >= 201103L
+template<class Iter, class Compare>
+inline void pdqsort_indirect(Iter begin, Iter end, Compare comp, pdqsort_context& context) {
+    if (begin == end) return;
+    pdqsort_detail::count_sort(context, end - begin);
+    if (!pdqsort_detail::sort_indirect(begin, end, comp, &context)) {
+        pdqsort_detail::pdqsort_loop<Iter, Compare, false>(
+            begin, end, comp, pdqsort_detail::log2(end - begin));
+    }
+}
+#endif
+
+// Sorts [begin, end) by first distributing it into many buckets at once with a branchless sample
+// sort step, and sorting the buckets with pdqsort. For very large inputs this takes far fewer
+// passes over memory than pdqsort's binary partitioning. Ranges below samplesort_threshold are
+// sorted by pdqsort right away. Larger ones need end - begin extra elements and bytes of memory,
+// and fall back to pdqsort if they can't be allocated. The sample is copied into default
+// constructed elements, so in C++11 types that aren't default constructible and copy assignable,
+// such as move-only types, are always sorted by pdqsort; before C++11 they are required.
+template<class Iter, class Compare>
+inline void pdqsort_samplesort(Iter begin, Iter end, Compare comp) {
+    if (begin == end) return;
+
+#if __cplusplus >= 201103L
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    const bool branchless = pdqsort_branchless_safe<typename std::decay<Compare>::type, T>::value;
+#else
+    const bool branchless = false;
 #endif
+    if (!pdqsort_detail::samplesort<Iter, Compare, branchless>(begin, end, comp)) {
+        pdqsort_detail::pdqsort_loop<Iter, Compare, branchless>(
+            begin, end, comp, pdqsort_detail::log2(end - begin));
+    }
 }
 
 template<class Iter>
-inline void pdqsort(Iter begin, Iter end) {
+inline void pdqsort_samplesort(Iter begin, Iter end) {
     typedef typename std::iterator_traits<Iter>::value_type T;
-    pdqsort(begin, end, std::less<T>());
+    pdqsort_samplesort(begin, end, std::less<T>());
 }
 
+#if __cplusplus >= 201103L
 template<class Iter, class Compare>
-inline void pdqsort_branchless(Iter begin, Iter end, Compare comp) {
+inline void pdqsort_samplesort(Iter begin, Iter end, Compare comp, pdqsort_context& context) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
     if (begin == end) return;
-    pdqsort_detail::pdqsort_loop<Iter, Compare, true>(
-        begin, end, comp, pdqsort_detail::log2(end - begin));
+    pdqsort_detail::count_sort(context, end - begin);
+
+    const bool branchless = pdqsort_branchless_safe<typename std::decay<Compare>::type, T>::value;
+    if (!pdqsort_detail::samplesort<Iter, Compare, branchless>(begin, end, comp, &context)) {
+        pdqsort_detail::pdqsort_loop<Iter, Compare, branchless>(
+            begin, end, comp, pdqsort_detail::log2(end - begin));
+    }
+}
+#endif
+
+// Sorts the num_segments independent ranges [data + offsets[i], data + offsets[i + 1]) each on its
+// own, e.g. per-user lists stored back to back. This avoids the per call overhead of pdqsort for
+// every segment. In C++11 the segments of up to fixed_network_max_size elements are binned by size
+// with a counting sort of their indices, and every bin is sorted with the sorting network of
+// pdqsort_fixed for that size, so the network is picked once per size instead of once per
+// segment. Larger segments are sorted with pdqsort. If the O(num_segments) memory for the bins
+// can't be allocated, or before C++11, small segments are insertion sorted one by one.
+template<class Iter, class OffsetIter, class Compare>
+inline void pdqsort_segmented(Iter data, OffsetIter offsets, std::size_t num_segments,
+                              Compare comp) {
+#if __cplusplus >= 201103L
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    const bool branchless = pdqsort_branchless_safe<typename std::decay<Compare>::type, T>::value;
+    const std::size_t max_fixed = pdqsort_detail::fixed_network_max_size;
+
+    // Sort the large segments and count the small ones by size.
+    std::size_t bin_start[max_fixed + 2] = { };
+    for (std::size_t i = 0; i < num_segments; ++i) {
+        std::ptrdiff_t size = offsets[i + 1] - offsets[i];
+        if (size < 2) continue;
+
+        if (std::size_t(size) > max_fixed) {
+            pdqsort_detail::pdqsort_loop<Iter, Compare, branchless>(
+                data + offsets[i], data + offsets[i + 1], comp, pdqsort_detail::log2(size));
+        } else {
+            ++bin_start[size + 1];
+        }
+    }
+
+    for (std::size_t size = 1; size <= max_fixed + 1; ++size) {
+        bin_start[size] += bin_start[size - 1];
+    }
+
+    pdqsort_detail::nothrow_buffer<std::size_t> bins(bin_start[max_fixed + 1]);
+    if (bins.data) {
+        std::size_t pos[max_fixed + 1];
+        std::copy(bin_start, bin_start + max_fixed + 1, pos);
+        for (std::size_t i = 0; i < num_segments; ++i) {
+            std::ptrdiff_t size = offsets[i + 1] - offsets[i];
+            if (size >= 2 && std::size_t(size) <= max_fixed) bins.data[pos[size]++] = i;
+        }
+
+        for (std::size_t size = 2; size <= max_fixed; ++size) {
+            pdqsort_detail::sort_fixed_segments(size, data, offsets, bins.data + bin_start[size],
+                                                bins.data + bin_start[size + 1], comp,
+                                                std::integral_constant<bool, branchless>());
+        }
+        return;
+    }
+
+    for (std::size_t i = 0; i < num_segments; ++i) {
+        std::ptrdiff_t size = offsets[i + 1] - offsets[i];
+        if (size < 2 || std::size_t(size) > max_fixed) continue;
+        pdqsort_detail::small_insertion_sort(data + offsets[i], data + offsets[i + 1], comp,
+                                             std::integral_constant<bool, branchless>());
+    }
+#else
+    for (std::size_t i = 0; i < num_segments; ++i) {
+        Iter begin = data + offsets[i];
+        Iter end = data + offsets[i + 1];
+        std::ptrdiff_t size = end - begin;
+        if (size < 2) continue;
+
+        if (size > pdqsort_detail::insertion_sort_threshold) {
+            pdqsort_detail::pdqsort_loop<Iter, Compare, false>(
+                begin, end, comp, pdqsort_detail::log2(size));
+        } else {
+            pdqsort_detail::insertion_sort(begin, end, comp);
+        }
+    }
+#endif
+}
+
+template<class Iter, class OffsetIter>
+inline void pdqsort_segmented(Iter data, OffsetIter offsets, std::size_t num_segments) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    pdqsort_segmented(data, offsets, num_segments, std::less<T>());
+}
+
+#if __cplusplus >= 201103L
+// Sorts the N elements starting at begin, where N is known at compile time. Up to 32 elements are
+// sorted by a sorting network that is fully unrolled, with compare-exchanges that are branchless if
+// the comparison is, so there are no size checks or loops at runtime. Larger N use pdqsort.
+template<std::size_t N, class Iter, class Compare>
+inline PDQSORT_CONSTEXPR void pdqsort_fixed(Iter begin, Compare comp) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    if (N > pdqsort_detail::fixed_network_max_size) {
+        pdqsort(begin, begin + N, comp);
+        return;
+    }
+
+    // Only instantiate networks that exist, even though larger N never get here.
+    const std::size_t size = N > pdqsort_detail::fixed_network_max_size ? 0 : N;
+    pdqsort_detail::fixed_sort<size>::apply(begin, comp,
+        std::integral_constant<bool,
+            pdqsort_branchless_safe<typename std::decay<Compare>::type, T>::value>());
+}
+
+template<std::size_t N, class Iter>
+inline PDQSORT_CONSTEXPR void pdqsort_fixed(Iter begin) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    pdqsort_fixed<N>(begin, std::less<T>());
+}
+
+template<class T, std::size_t N, class Compare>
+inline PDQSORT_CONSTEXPR void pdqsort_fixed(std::array<T, N>& array, Compare comp) {
+    pdqsort_fixed<N>(array.begin(), comp);
+}
+
+template<class T, std::size_t N>
+inline PDQSORT_CONSTEXPR void pdqsort_fixed(std::array<T, N>& array) {
+    pdqsort_fixed<N>(array.begin(), std::less<T>());
+}
+#endif
+
+// Partitions [begin, end) so that the elements for which pred is true come before those for which
+// it is false, like std::partition, and returns the partition point. Uses the same block based
+// branchless partitioning as pdqsort, so it is fast even if pred is unpredictable, as long as pred
+// itself doesn't branch. The relative order of elements is not preserved.
+template<class Iter, class Predicate>
+inline Iter pdq_partition(Iter begin, Iter end, Predicate pred) {
+    if (begin == end) return end;
+    return pdqsort_detail::partition_blocks(begin, end, pred);
+}
+
+// Reorders [begin, end) in place so the elements are grouped by the bucket classifier(x) returns,
+// which must be in [0, k), in ascending bucket order. The relative order within a bucket is not
+// preserved. If given, bucket_begins receives k + 1 offsets from begin: the start of every bucket
+// and the end of the last one, as pdqsort_segmented takes them. Takes log2(k) passes of
+// pdq_partition, so the classifier should be cheap.
+template<class Iter, class Classifier, class OffsetIter>
+inline void pdq_bucketize(Iter begin, Iter end, Classifier classifier, std::size_t k,
+                          OffsetIter bucket_begins) {
+    if (k == 0) return;
+    *bucket_begins = std::size_t(0); ++bucket_begins;
+    pdqsort_detail::bucketize(begin, begin, end, classifier, 0, k, bucket_begins);
+    *bucket_begins = std::size_t(end - begin);
+}
+
+template<class Iter, class Classifier>
+inline void pdq_bucketize(Iter begin, Iter end, Classifier classifier, std::size_t k) {
+    pdq_bucketize(begin, end, classifier, k, pdqsort_detail::discard_output());
+}
+
+// Merges the sorted ranges [first, last) given as std::pairs of iterators in [ranges_begin,
+// ranges_end) into out, and returns the end of the output. Uses a loser tree, so every element
+// costs log2(k) comparisons for k ranges, without data dependent branches if the comparison is
+// branchless. The merge is stable: equal elements keep their order, and those from earlier ranges
+// come first. For more than merge_k_stack_ranges ranges O(k) memory is allocated, and
+// std::bad_alloc is thrown if that fails.
+template<class RangeIter, class OutIter, class Compare>
+inline OutIter pdq_merge_k(RangeIter ranges_begin, RangeIter ranges_end, OutIter out,
+                           Compare comp) {
+    std::size_t k = std::size_t(ranges_end - ranges_begin);
+    if (k == 0) return out;
+    if (k == 1) return std::copy(ranges_begin->first, ranges_begin->second, out);
+
+#if __cplusplus >= 201103L
+    typedef typename std::iterator_traits<RangeIter>::value_type::first_type Iter;
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    const bool branchless = pdqsort_branchless_safe<typename std::decay<Compare>::type, T>::value &&
+                            std::is_trivially_copyable<T>::value;
+#else
+    const bool branchless = false;
+#endif
+    return pdqsort_detail::merge_k<branchless>(ranges_begin, k, out, comp);
+}
+
+template<class RangeIter, class OutIter>
+inline OutIter pdq_merge_k(RangeIter ranges_begin, RangeIter ranges_end, OutIter out) {
+    typedef typename std::iterator_traits<RangeIter>::value_type::first_type Iter;
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    return pdq_merge_k(ranges_begin, ranges_end, out, std::less<T>());
+}
+
+// Splits the merge of the sorted ranges in [ranges_begin, ranges_end), as done by pdq_merge_k,
+// after its first rank elements: splits[i] is set to where range i is split. Merging the ranges
+// before the splits and those after them independently, e.g. on two threads, writes the same
+// output as merging everything at once. Takes O(k^2 log^2 n) comparisons for k ranges of up to n
+// elements, and allocates O(k) memory for more than merge_k_stack_ranges ranges.
+template<class RangeIter, class SplitIter, class Compare>
+inline void pdq_merge_k_split(RangeIter ranges_begin, RangeIter ranges_end, std::size_t rank,
+                              SplitIter splits, Compare comp) {
+    typedef typename std::iterator_traits<RangeIter>::value_type::first_type Iter;
+    std::size_t k = std::size_t(ranges_end - ranges_begin);
+    if (k == 0) return;
+
+    if (k <= pdqsort_detail::merge_k_stack_ranges) {
+        Iter hi[pdqsort_detail::merge_k_stack_ranges];
+        Iter pos[pdqsort_detail::merge_k_stack_ranges];
+        pdqsort_detail::merge_k_split(ranges_begin, k, rank, splits, comp, hi, pos);
+        return;
+    }
+
+    pdqsort_detail::nothrow_buffer<Iter> iters(2 * k);
+    if (!iters.data) throw std::bad_alloc();
+    pdqsort_detail::merge_k_split(ranges_begin, k, rank, splits, comp, iters.data, iters.data + k);
+}
+
+template<class RangeIter, class SplitIter>
+inline void pdq_merge_k_split(RangeIter ranges_begin, RangeIter ranges_end, std::size_t rank,
+                              SplitIter splits) {
+    typedef typename std::iterator_traits<RangeIter>::value_type::first_type Iter;
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    pdq_merge_k_split(ranges_begin, ranges_end, rank, splits, std::less<T>());
+}
+
+// Sorts [begin, end) and merges every run of equivalent elements into its first element with
+// acc = combine(acc, x), in one pass instead of sorting first and reducing after. Returns the end of
+// the sorted range of merged elements; elements after it are left in a valid but unspecified state.
+// The order in which equivalent elements are combined is unspecified, so combine should be
+// associative and commutative.
+template<class Iter, class Compare, class Combine>
+inline Iter pdqsort_reduce(Iter begin, Iter end, Compare comp, Combine combine) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    if (begin == end) return end;
+
+#if __cplusplus >= 201103L
+    const bool branchless = pdqsort_branchless_safe<typename std::decay<Compare>::type, T>::value;
+#else
+    const bool branchless = false;
+#endif
+    pdqsort_detail::combine_into<T, Combine> reduce(combine);
+    return pdqsort_detail::pdqsort_reduce_loop<Iter, Compare,
+        pdqsort_detail::combine_into<T, Combine>, branchless>(
+        begin, begin, begin, end, comp, reduce, pdqsort_detail::log2(end - begin));
+}
+
+// Sorts [begin, end) and removes duplicates like std::unique, returning the end of the sorted range
+// of unique elements. Which of the equivalent elements is kept is unspecified.
+template<class Iter, class Compare>
+inline Iter pdqsort_unique(Iter begin, Iter end, Compare comp) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    if (begin == end) return end;
+
+#if __cplusplus >= 201103L
+    const bool branchless = pdqsort_branchless_safe<typename std::decay<Compare>::type, T>::value;
+#else
+    const bool branchless = false;
+#endif
+    pdqsort_detail::keep_first<T> reduce;
+    return pdqsort_detail::pdqsort_reduce_loop<Iter, Compare,
+        pdqsort_detail::keep_first<T>, branchless>(
+        begin, begin, begin, end, comp, reduce, pdqsort_detail::log2(end - begin));
 }
 
 template<class Iter>
-inline void pdqsort_branchless(Iter begin, Iter end) {
+inline Iter pdqsort_unique(Iter begin, Iter end) {
     typedef typename std::iterator_traits<Iter>::value_type T;
-    pdqsort_branchless(begin, end, std::less<T>());
+    return pdqsort_unique(begin, end, std::less<T>());
+}
+
+#if __cplusplus >= 201103L
+// Sorts a range of float or double in ascending order. Unlike std::less this is well defined in the
+// presence of NaNs, which are placed according to policy.
+template<class Iter>
+inline void pdqsort_float(Iter begin, Iter end, pdqsort_nan_policy policy = pdqsort_nans_last) {
+    typedef typename std::iterator_traits<Iter>::value_type F;
+    static_assert(std::numeric_limits<F>::is_iec559, "pdqsort_float requires IEEE 754 floats");
+    if (begin == end) return;
+
+    // Move the NaNs out of the way, the remaining numbers sort the same under totalOrder as under
+    // operator<, except that -0 goes before +0.
+    if (policy == pdqsort_nans_first) {
+        begin = std::partition(begin, end, pdqsort_detail::is_nan<F>());
+    } else if (policy == pdqsort_nans_last) {
+        end = std::partition(begin, end, pdqsort_detail::is_not_nan<F>());
+    }
+
+    if (begin != end) pdqsort_detail::sort_float_total_order(begin, end);
+}
+
+template<class Iter, class KeyFn, class Compare>
+inline void pdqsort_indirect_by_key(Iter begin, Iter end, KeyFn key, Compare comp) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    typedef typename pdqsort_detail::key_type<KeyFn, T>::type Key;
+    if (begin == end) return;
+
+    const bool branchless = pdqsort_branchless_safe<typename std::decay<Compare>::type, Key>::value;
+    if (!pdqsort_detail::sort_indirect_by_key<branchless>(begin, end, key, comp)) {
+        typedef pdqsort_detail::projected_compare<KeyFn, Compare> ProjCompare;
+        pdqsort_detail::pdqsort_loop<Iter, ProjCompare, false>(
+            begin, end, ProjCompare(key, comp), pdqsort_detail::log2(end - begin));
+    }
+}
+
+template<class Iter, class KeyFn>
+inline void pdqsort_indirect_by_key(Iter begin, Iter end, KeyFn key) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    typedef typename pdqsort_detail::key_type<KeyFn, T>::type Key;
+    pdqsort_indirect_by_key(begin, end, key, std::less<Key>());
+}
+
+template<class Iter, class KeyFn, class Compare>
+inline void pdqsort_indirect_by_key(Iter begin, Iter end, KeyFn key, Compare comp,
+                                    pdqsort_context& context) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    typedef typename pdqsort_detail::key_type<KeyFn, T>::type Key;
+    if (begin == end) return;
+    pdqsort_detail::count_sort(context, end - begin);
+
+    const bool branchless = pdqsort_branchless_safe<typename std::decay<Compare>::type, Key>::value;
+    if (!pdqsort_detail::sort_indirect_by_key<branchless>(begin, end, key, comp, &context)) {
+        typedef pdqsort_detail::projected_compare<KeyFn, Compare> ProjCompare;
+        pdqsort_detail::pdqsort_loop<Iter, ProjCompare, false>(
+            begin, end, ProjCompare(key, comp), pdqsort_detail::log2(end - begin));
+    }
+}
+
+// Sorts num_records records of record_size bytes stored back to back at data, e.g. the 100 byte
+// records of TeraSort with 10 byte keys, by the key_size bytes at key_offset in every record,
+// compared like memcmp. The first 8 bytes of every key are extracted as a big-endian integer and
+// sorted together with the record's index on the branchless integer path, only records with equal
+// prefixes compare the rest of their keys with memcmp, and the records are moved only after that.
+// They are gathered into a copy of the buffer and copied back, so every record is copied twice
+// through n * record_size bytes of scratch, which beats permuting them in place from about 10^5
+// records on. If the copy can't be allocated they are permuted in place, moving every record once.
+// The sort is stable. Needs O(n) extra memory for the prefixes and throws std::bad_alloc if that
+// can't be allocated.
+inline void pdqsort_records(void* data, std::size_t num_records, std::size_t record_size,
+                            std::size_t key_offset, std::size_t key_size) {
+    if (num_records < 2 || key_size == 0) return;
+    pdqsort_detail::sort_records(data, num_records, record_size, key_offset, key_size, 0);
+}
+
+inline void pdqsort_records(void* data, std::size_t num_records, std::size_t record_size,
+                            std::size_t key_offset, std::size_t key_size,
+                            pdqsort_context& context) {
+    pdqsort_detail::count_sort(context, num_records);
+    if (num_records < 2 || key_size == 0) return;
+    pdqsort_detail::sort_records(data, num_records, record_size, key_offset, key_size, &context);
+}
+
+// Sorts [begin, end) lexicographically by the std::tuple returned by key. The fields may be
+// integers, enums, bools, floats (ordered by IEEE 754 totalOrder) or pdqsort_descending(field),
+// and must add up to at most 64 bits, or 128 bits where the compiler supports it. They are packed
+// into a single order-preserving unsigned integer, so the sort compares one integer instead of
+// going through branchy tuple comparisons.
+template<class Iter, class KeyFn>
+inline void pdqsort_packed(Iter begin, Iter end, KeyFn key) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    typedef pdqsort_detail::packed_key_fn<KeyFn, T> PackedKeyFn;
+    typedef typename PackedKeyFn::type Packed;
+    typedef pdqsort_detail::projected_compare<PackedKeyFn, std::less<Packed> > PackedCompare;
+    if (begin == end) return;
+
+    // Keys are packed on the fly for every comparison, unless elements are big enough that
+    // sorting (packed key, index) pairs pays off.
+    if (sizeof(T) <= pdqsort_detail::indirect_sort_threshold ||
+        !pdqsort_detail::sort_indirect_by_key<true>(begin, end, PackedKeyFn(key),
+                                                    std::less<Packed>())) {
+        pdqsort_detail::pdqsort_loop<Iter, PackedCompare, true>(
+            begin, end, PackedCompare(PackedKeyFn(key), std::less<Packed>()),
+            pdqsort_detail::log2(end - begin));
+    }
+}
+
+// Sorts [begin, end) with the engine that suits the input, and returns the decision for
+// diagnostics. The input is inspected from cheap to expensive: sorted input is left alone, a long
+// sorted prefix is merged with the sorted rest by pdqsort_append, a few sorted runs (e.g.
+// concatenated log shards) of copyable and default constructible elements are merged by
+// pdq_merge_k, and integers and enums compared by std::less or std::greater are counted if they
+// span a small range, or radix sorted if there are many, they differ in at most 4 bytes and a
+// sample shows they aren't mostly duplicates. Everything else, including move-only types, is
+// sorted by pdqsort, which is also the fallback if the memory merging or radix sorting needs can't
+// be allocated. Inspecting costs at most a scan for the smallest and largest integer and sorting a
+// sample of 64, while skipping pdqsort in the cases above gains up to O(log n) per element. The
+// sort is not stable.
+template<class Iter, class Compare>
+inline pdqsort_decision pdqsort_auto(Iter begin, Iter end, Compare comp) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    const int direction =
+        pdqsort_detail::compare_direction<typename std::decay<Compare>::type, T>::value;
+    const bool integer_key = pdqsort_detail::is_integer_key<T>::value && direction != 0;
+
+    pdqsort_detail::runs_engine<Iter, pdqsort_detail::is_mergeable<T>::value> runs;
+    pdqsort_detail::integer_engine<T, integer_key> integer;
+    pdqsort_decision decision = pdqsort_detail::choose_engine(begin, end, comp, runs, integer);
+
+    switch (decision.engine) {
+    case pdqsort_engine_none:
+        return decision;
+
+    case pdqsort_engine_append:
+        pdqsort_append(begin, begin + decision.sorted_prefix, end, comp);
+        return decision;
+
+    case pdqsort_engine_runs:
+        if (runs.sort(begin, decision.size, comp)) return decision;
+        break;
+
+    case pdqsort_engine_counting:
+    case pdqsort_engine_radix:
+        if (integer.sort(begin, end, decision.engine, direction < 0)) return decision;
+        break;
+
+    case pdqsort_engine_pdqsort:
+        break;
+    }
+
+    decision.engine = pdqsort_engine_pdqsort;
+    pdqsort(begin, end, comp);
+    return decision;
+}
+
+template<class Iter>
+inline pdqsort_decision pdqsort_auto(Iter begin, Iter end) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    return pdqsort_auto(begin, end, std::less<T>());
+}
+#endif
+
+// Sorts [begin, end) in slices, for callers that can't block for a whole sort, such as event loops.
+// Every call to step(budget) does roughly budget units of work, a unit being about one comparison
+// and one move, and returns whether the range is sorted. The range must not be modified until the
+// sort is done.
+//
+// This runs the same algorithm as pdqsort with its pending range stack kept in the object. Pending
+// ranges whose sort fits in the remaining budget are sorted with pdqsort in one go. Larger ones are
+// partitioned a slice at a time with a Hoare partition, whose state is just two positions. The
+// insertion sort attempted on already partitioned ranges and the heapsort fallback for too many
+// bad partitions are done in slices as well, so no single call does much more work than asked
+// for, regardless of the size of the range.
+template<class Iter, class Compare = std::less<typename std::iterator_traits<Iter>::value_type> >
+class pdqsort_resumable {
+public:
+    pdqsort_resumable(Iter begin, Iter end, Compare comp = Compare())
+        : comp(comp), stack_size(0), stage(idle), blocks(begin, end) {
+        if (end - begin > 1) push(begin, end, pdqsort_detail::log2(end - begin), true);
+    }
+
+    bool done() const { return stack_size == 0 && stage == idle; }
+
+    bool step(std::size_t budget) {
+        std::size_t left = budget;
+
+        while (!done()) {
+            if (stage != idle) {
+                if (stage == scanning) {
+                    left -= scan(left);
+                } else if (stage == inserting) {
+                    left -= insert(left);
+                } else {
+                    left -= heap_sort(left);
+                }
+
+                if (stage != idle && left == 0) return false;
+                continue;
+            }
+
+            // A range that fits in a whole step but not in the rest of this one is left for the
+            // next step rather than partitioned, which would take more work in total.
+            const pdqsort_detail::pending_range<Iter>& next = stack[stack_size - 1];
+            diff_t size = next.end - next.begin;
+            std::size_t cost = std::size_t(size) * (pdqsort_detail::log2(size) + 1);
+            if (left == 0 || (cost > left && cost <= budget)) return false;
+
+            part = stack[--stack_size];
+            if (size < pdqsort_detail::insertion_sort_threshold || cost <= left) {
+                pdqsort_detail::pdqsort_loop<Iter, Compare, branchless>(
+                    part.begin, part.end, comp, part.bad_allowed, part.leftmost);
+                left -= cost < left ? cost : left;
+            } else {
+                start_partition();
+            }
+        }
+
+        return true;
+    }
+
+private:
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    typedef typename std::iterator_traits<Iter>::difference_type diff_t;
+    typedef typename pdqsort_detail::partition_block<T>::offset_type offset_type;
+
+#if __cplusplus >= 201103L
+    static const bool branchless = pdqsort_branchless_safe<Compare, T>::value;
+#else
+    static const bool branchless = false;
+#endif
+
+    // What the range in part is going through: nothing, partitioning, the insertion sort attempted
+    // after an already partitioned range, or heapsort's two phases.
+    enum stage_type { idle, scanning, inserting, heap_building, heap_extracting };
+
+    void push(Iter begin, Iter end, int bad_allowed, bool leftmost) {
+        if (end - begin < 2) return;
+        pdqsort_detail::pending_range<Iter>& pending = stack[stack_size++];
+        pending.begin = begin;
+        pending.end = end;
+        pending.bad_allowed = bad_allowed;
+        pending.leftmost = leftmost;
+    }
+
+    // Chooses a pivot for part like pdqsort_loop does, and starts partitioning around it. As in
+    // pdqsort_loop, a pivot equal to the element before the range puts equal elements left.
+    void start_partition() {
+        pdqsort_detail::choose_pivot(part.begin, part.end, comp);
+        equal_left = !part.leftmost && !comp(*(part.begin - 1), *part.begin);
+        first = part.begin + 1;
+        last = part.end;
+        seeking_last = swapped = false;
+        stage = scanning;
+    }
+
+    // Partitions part for up to budget comparisons, and returns the number done. This is the
+    // Hoare partition of partition_right, so it swaps the same elements and an already partitioned
+    // range is left as is, but both searches are guarded since they may be suspended anywhere.
+    // [part.begin + 1, first) is left of the pivot *part.begin and [last, part.end) right of it.
+    // For branchless comparisons the rest is done in blocks after the first swap, like in
+    // partition_right_branchless. The scan never touches part.begin, so the pivot is compared
+    // where it is instead of moved out.
+    std::size_t scan(std::size_t budget) {
+        const T& pivot = *part.begin;
+        if (equal_left) {
+            return scan(budget, pdqsort_detail::not_greater_than<T, Compare>(pivot, comp));
+        }
+
+        return scan(budget, pdqsort_detail::less_than_pivot<T, Compare>(pivot, comp));
+    }
+
+    template<class Predicate>
+    std::size_t scan(std::size_t budget, Predicate goes_left) {
+        if (swapped && branchless) {
+            std::size_t num = pdqsort_detail::scan_blocks(blocks, goes_left, offsets_l, offsets_r,
+                                                          budget);
+            if (!(blocks.first < blocks.last)) {
+                first = pdqsort_detail::finish_blocks(blocks, offsets_l, offsets_r);
+                finish_partition();
+            }
+
+            return num < budget ? num : budget;
+        }
+
+        // Local copies, as the compiler can't tell whether the swaps overwrite the members.
+        Iter l = first;
+        Iter r = last;
+        std::size_t num = 0;
+        while (l != r) {
+            std::size_t rest = budget - num;
+            if (rest == 0) break;
+
+            diff_t n = r - l;
+            if (std::size_t(n) > rest) n = diff_t(rest);
+            if (!seeking_last) {
+                Iter stop = l + n;
+                Iter start = l;
+                while (l != stop && goes_left(*l)) ++l;
+                num += std::size_t(l - start);
+                if (l == stop) continue;
+                ++num;
+                seeking_last = true;
+            } else {
+                Iter stop = r - n;
+                Iter start = r;
+                while (r != stop && !goes_left(*(r - 1))) --r;
+                num += std::size_t(start - r);
+                if (r == stop) continue;
+                ++num;
+                std::iter_swap(l++, --r);
+                seeking_last = false;
+                swapped = true;
+
+                if (branchless) {
+                    blocks = pdqsort_detail::block_partition<Iter>(l, r);
+                    first = l;
+                    last = r;
+                    return num + scan(budget - num, goes_left);
+                }
+            }
+        }
+
+        first = l;
+        last = r;
+        if (l == r) finish_partition();
+        return num < budget ? num : budget;
+    }
+
+    // Puts the pivot in place and pushes the partitions, handling bad partitions like pdqsort_loop.
+    // Heapsort and the insertion sort of already partitioned ranges are only started here.
+    void finish_partition() {
+        stage = idle;
+
+        Iter begin = part.begin;
+        Iter end = part.end;
+        pivot_pos = first - 1;
+        std::iter_swap(begin, pivot_pos);
+
+        // Everything left of the pivot is equal to it, only the right partition needs sorting.
+        if (equal_left) {
+            push(pivot_pos + 1, end, part.bad_allowed, false);
+            return;
+        }
+
+        diff_t size = end - begin;
+        diff_t l_size = pivot_pos - begin;
+        diff_t r_size = end - (pivot_pos + 1);
+        bad_allowed = part.bad_allowed;
+        if (l_size < size / 8 || r_size < size / 8) {
+            if (--bad_allowed == 0) {
+                heap_pos = size / 2;
+                heap_cost = std::size_t(pdqsort_detail::log2(size)) + 1;
+                stage = heap_building;
+                return;
+            }
+
+            pdqsort_detail::break_patterns(begin, pivot_pos, end);
+        } else if (!swapped) {
+            insertion_begin = begin;
+            insertion_end = pivot_pos;
+            insertion_cur = begin + 1;
+            insertion_moves = 0;
+            stage = inserting;
+            return;
+        }
+
+        push_partitions();
+    }
+
+    // The smaller partition is pushed last, so it is sorted first and the stack stays shallow.
+    void push_partitions() {
+        if (pivot_pos - part.begin > part.end - (pivot_pos + 1)) {
+            push(part.begin, pivot_pos, bad_allowed, part.leftmost);
+            push(pivot_pos + 1, part.end, bad_allowed, false);
+        } else {
+            push(pivot_pos + 1, part.end, bad_allowed, false);
+            push(part.begin, pivot_pos, bad_allowed, part.leftmost);
+        }
+    }
+
+    // Continues partial_insertion_sort on the left and then the right partition for up to budget
+    // elements, and returns the number done. As soon as more than partial_insertion_sort_limit
+    // elements were moved it gives up, stopping a sift halfway if need be, and pushes the
+    // partitions instead.
+    std::size_t insert(std::size_t budget) {
+        std::size_t num = 0;
+        while (num < budget) {
+            if (insertion_end - insertion_cur <= 0) {
+                if (insertion_end == part.end) {
+                    stage = idle;
+                    return num;
+                }
+
+                insertion_begin = pivot_pos + 1;
+                insertion_end = part.end;
+                insertion_cur = insertion_begin == insertion_end ? insertion_end
+                                                                 : insertion_begin + 1;
+                continue;
+            }
+
+            ++num;
+            Iter cur = insertion_cur++;
+            if (!comp(*cur, *(cur - 1))) continue;
+
+            std::size_t allowed =
+                std::size_t(pdqsort_detail::partial_insertion_sort_limit) - insertion_moves + 1;
+            T tmp = PDQSORT_PREFER_MOVE(*cur);
+            Iter sift = cur;
+            do { *sift = PDQSORT_PREFER_MOVE(*(sift - 1)); --sift; }
+            while (std::size_t(cur - sift) < allowed && sift != insertion_begin &&
+                   comp(tmp, *(sift - 1)));
+            *sift = PDQSORT_PREFER_MOVE(tmp);
+
+            insertion_moves += cur - sift;
+            if (insertion_moves > pdqsort_detail::partial_insertion_sort_limit) {
+                stage = idle;
+                push_partitions();
+                return num;
+            }
+        }
+
+        return num;
+    }
+
+    // Continues the bottom-up heapsort of part by sifts of heap_cost units while budget lasts, and
+    // returns the work done. Builds the heap like pdqsort_detail::heap_sort, then extracts.
+    std::size_t heap_sort(std::size_t budget) {
+        Iter begin = part.begin;
+        diff_t size = part.end - begin;
+        std::size_t num = 0;
+        while (num < budget) {
+            if (stage == heap_building) {
+                if (heap_pos == 0) {
+                    heap_pos = size - 1;
+                    stage = heap_extracting;
+                    continue;
+                }
+
+                --heap_pos;
+                T value = PDQSORT_PREFER_MOVE(begin[heap_pos]);
+                pdqsort_detail::sift_down(begin, heap_pos, size, value, comp);
+            } else {
+                if (heap_pos == 0) {
+                    stage = idle;
+                    break;
+                }
+
+                T value = PDQSORT_PREFER_MOVE(begin[heap_pos]);
+                begin[heap_pos] = PDQSORT_PREFER_MOVE(begin[0]);
+                pdqsort_detail::sift_down(begin, diff_t(0), heap_pos, value, comp);
+                --heap_pos;
+            }
+
+            num += heap_cost;
+        }
+
+        return num < budget ? num : budget;
+    }
+
+    Compare comp;
+    pdqsort_detail::pending_range<Iter> stack[sizeof(std::size_t) * 8];
+    std::size_t stack_size;
+
+    // State of the range in progress. Partitioning scans it with first and last, or with blocks
+    // and its offsets once partition_blocks takes over, after which it is split at pivot_pos.
+    // The insertion sort is at insertion_cur in the partition [insertion_begin, insertion_end),
+    // and heapsort at heap_pos.
+    pdqsort_detail::pending_range<Iter> part;
+    stage_type stage;
+    Iter first;
+    Iter last;
+    bool equal_left;
+    bool seeking_last;
+    bool swapped;
+    pdqsort_detail::block_partition<Iter> blocks;
+    offset_type offsets_l[pdqsort_detail::partition_block<T>::size];
+    offset_type offsets_r[pdqsort_detail::partition_block<T>::size];
+    Iter pivot_pos;
+    int bad_allowed;
+    Iter insertion_begin;
+    Iter insertion_end;
+    Iter insertion_cur;
+    std::size_t insertion_moves;
+    diff_t heap_pos;
+    std::size_t heap_cost;
+};
+
+// Sorted view of [begin, end) that sorts lazily, for consumers that stop after an unknown number of
+// elements, e.g. pagination. Every call to next() puts the next smallest element in its final
+// position and returns it. This is incremental quicksort (Paredes and Navarro) with pdqsort's pivot
+// selection, partitioning and bad partition handling: the stack holds the pivots to the right of
+// the current position, and only the part up to the nearest pivot is partitioned further. Taking k
+// elements costs O(n + k log k) on average, and parts of the range that are never reached are
+// never sorted. The range must not be modified while the view is in use.
+template<class Iter, class Compare = std::less<typename std::iterator_traits<Iter>::value_type> >
+class pdqsort_incremental {
+public:
+    pdqsort_incremental(Iter begin, Iter end, Compare comp = Compare())
+        : comp(comp), first(begin), cur(begin), sorted_end(begin), stack_size(0) {
+        push(end, end - begin > 0 ? pdqsort_detail::log2(end - begin) : 0);
+    }
+
+    bool done() const { return cur == stack[0].pos; }
+
+    // Returns the next smallest element, which is in its final position. Requires !done().
+    Iter next() {
+        typedef typename std::iterator_traits<Iter>::difference_type diff_t;
+
+        while (cur == sorted_end) {
+            pivot_entry& top = stack[stack_size - 1];
+
+            // Reached the next pivot, which is in its final position already.
+            if (top.pos == cur) {
+                --stack_size;
+                ++sorted_end;
+                break;
+            }
+
+            diff_t size = top.pos - cur;
+            if (size < pdqsort_detail::insertion_sort_threshold) {
+                if (cur == first) pdqsort_detail::insertion_sort(cur, top.pos, comp);
+                else pdqsort_detail::unguarded_insertion_sort(cur, top.pos, comp);
+                sorted_end = top.pos;
+                break;
+            }
+
+            pdqsort_detail::choose_pivot(cur, top.pos, comp);
+
+            // As in pdqsort_loop, a pivot equal to the element before cur means all elements equal
+            // to it are final as soon as partition_left moved them left.
+            if (cur != first && !comp(*(cur - 1), *cur)) {
+                sorted_end = pdqsort_detail::partition_left(cur, top.pos, comp) + 1;
+                break;
+            }
+
+            std::pair<Iter, bool> part_result =
+                branchless ? pdqsort_detail::partition_right_branchless(cur, top.pos, comp)
+                           : pdqsort_detail::partition_right(cur, top.pos, comp);
+            Iter pivot_pos = part_result.first;
+            bool already_partitioned = part_result.second;
+
+            diff_t l_size = pivot_pos - cur;
+            diff_t r_size = top.pos - (pivot_pos + 1);
+            if (l_size < size / 8 || r_size < size / 8) {
+                if (--top.bad_allowed == 0) {
+                    pdqsort_detail::heap_sort(cur, top.pos, comp);
+                    sorted_end = top.pos;
+                    break;
+                }
+
+                pdqsort_detail::break_patterns(cur, pivot_pos, top.pos);
+            } else if (already_partitioned &&
+                       pdqsort_detail::partial_insertion_sort(cur, pivot_pos, comp) &&
+                       pdqsort_detail::partial_insertion_sort(pivot_pos + 1, top.pos, comp)) {
+                sorted_end = top.pos;
+                break;
+            }
+
+            // top's bad_allowed now applies to the right partition, like it does in pdqsort_loop.
+            push(pivot_pos, top.bad_allowed);
+        }
+
+        return cur++;
+    }
+
+private:
+    // A pivot in its final position, with the bad partitions allowed while sorting the elements
+    // between the previous pivot and it.
+    struct pivot_entry {
+        Iter pos;
+        int bad_allowed;
+    };
+
+    void push(Iter pos, int bad_allowed) {
+        stack[stack_size].pos = pos;
+        stack[stack_size].bad_allowed = bad_allowed;
+        ++stack_size;
+    }
+
+#if __cplusplus >= 201103L
+    static const bool branchless = pdqsort_branchless_safe<
+        Compare, typename std::iterator_traits<Iter>::value_type>::value;
+#else
+    static const bool branchless = false;
+#endif
+
+    // Every pivot splits off at most 7/8 of what remains to its left, and only bad_allowed pivots
+    // on a path may do worse, so the stack holds at most log_{8/7}(n) + log2(n) < 6.2 log2(n)
+    // pivots, plus the end of the range.
+    enum { max_stack_size = sizeof(std::size_t) * 8 * 7 };
+
+    Compare comp;
+    Iter first;
+    Iter cur;
+    Iter sorted_end;
+    pivot_entry stack[max_stack_size];
+    std::size_t stack_size;
+};
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+// Sorts [begin, end) as a coroutine of the caller's Task type, which needs to support co_return;.
+// After every budget units of work, see pdqsort_resumable, it suspends on co_await yield(), e.g. an
+// awaitable that reschedules it on the event loop.
+template<class Task, class Iter, class Compare, class Yield>
+Task pdqsort_coroutine(Iter begin, Iter end, Compare comp, std::size_t budget, Yield yield) {
+    pdqsort_resumable<Iter, Compare> sorter(begin, end, comp);
+    while (!sorter.step(budget)) co_await yield();
 }
+#endif
 
 
 #undef PDQSORT_PREFER_MOVE